@@ -0,0 +1,199 @@
+#include "affine.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define AFFINE_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AFFINE_NEON
+#endif
+
+namespace affine
+{
+
+void apply(const float op[12], float *matrices, const qsizetype count, const qsizetype stride)
+{
+    // each output row is a blend of the three input rows plus the op's
+    // translation in the last lane, which picks up the input translation too
+#if defined(AFFINE_SSE)
+    const __m128 a00 = _mm_set1_ps(op[0]), a01 = _mm_set1_ps(op[1]), a02 = _mm_set1_ps(op[2]);
+    const __m128 a10 = _mm_set1_ps(op[4]), a11 = _mm_set1_ps(op[5]), a12 = _mm_set1_ps(op[6]);
+    const __m128 a20 = _mm_set1_ps(op[8]), a21 = _mm_set1_ps(op[9]), a22 = _mm_set1_ps(op[10]);
+    const __m128 t0 = _mm_set_ps(op[3], 0.0f, 0.0f, 0.0f);
+    const __m128 t1 = _mm_set_ps(op[7], 0.0f, 0.0f, 0.0f);
+    const __m128 t2 = _mm_set_ps(op[11], 0.0f, 0.0f, 0.0f);
+    for (qsizetype i = 0; i < count; ++i) {
+        float *m = matrices + i * stride;
+        const __m128 b0 = _mm_loadu_ps(m);
+        const __m128 b1 = _mm_loadu_ps(m + 4);
+        const __m128 b2 = _mm_loadu_ps(m + 8);
+        const __m128 r0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, b0), _mm_mul_ps(a01, b1)),
+                                     _mm_add_ps(_mm_mul_ps(a02, b2), t0));
+        const __m128 r1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a10, b0), _mm_mul_ps(a11, b1)),
+                                     _mm_add_ps(_mm_mul_ps(a12, b2), t1));
+        const __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a20, b0), _mm_mul_ps(a21, b1)),
+                                     _mm_add_ps(_mm_mul_ps(a22, b2), t2));
+        _mm_storeu_ps(m, r0);
+        _mm_storeu_ps(m + 4, r1);
+        _mm_storeu_ps(m + 8, r2);
+    }
+#elif defined(AFFINE_NEON)
+    const float t0v[4] = {0.0f, 0.0f, 0.0f, op[3]};
+    const float t1v[4] = {0.0f, 0.0f, 0.0f, op[7]};
+    const float t2v[4] = {0.0f, 0.0f, 0.0f, op[11]};
+    const float32x4_t t0 = vld1q_f32(t0v), t1 = vld1q_f32(t1v), t2 = vld1q_f32(t2v);
+    for (qsizetype i = 0; i < count; ++i) {
+        float *m = matrices + i * stride;
+        const float32x4_t b0 = vld1q_f32(m);
+        const float32x4_t b1 = vld1q_f32(m + 4);
+        const float32x4_t b2 = vld1q_f32(m + 8);
+        const float32x4_t r0 = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(t0, b0, op[0]), b1, op[1]), b2,
+                                           op[2]);
+        const float32x4_t r1 = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(t1, b0, op[4]), b1, op[5]), b2,
+                                           op[6]);
+        const float32x4_t r2 = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(t2, b0, op[8]), b1, op[9]), b2,
+                                           op[10]);
+        vst1q_f32(m, r0);
+        vst1q_f32(m + 4, r1);
+        vst1q_f32(m + 8, r2);
+    }
+#else
+    for (qsizetype i = 0; i < count; ++i) {
+        float *m = matrices + i * stride;
+        float r[12];
+        for (int row = 0; row < 3; ++row) {
+            const float *a = op + row * 4;
+            for (int col = 0; col < 4; ++col) {
+                r[row * 4 + col] = a[0] * m[col] + a[1] * m[4 + col] + a[2] * m[8 + col];
+            }
+            r[row * 4 + 3] += a[3];
+        }
+        std::memcpy(m, r, sizeof(r));
+    }
+#endif
+}
+
+void bounds(const float *matrices, const float *local, float *world, const qsizetype count,
+            const qsizetype stride)
+{
+    // transform the centre, the extent grows by the absolute of the linear part
+    for (qsizetype i = 0; i < count; ++i) {
+        const float *m = matrices + i * stride;
+        const float *b = local + i * 6;
+        float *w = world + i * 6;
+        const float cx = 0.5f * (b[0] + b[3]);
+        const float cy = 0.5f * (b[1] + b[4]);
+        const float cz = 0.5f * (b[2] + b[5]);
+        const float ex = 0.5f * (b[3] - b[0]);
+        const float ey = 0.5f * (b[4] - b[1]);
+        const float ez = 0.5f * (b[5] - b[2]);
+#if defined(AFFINE_SSE)
+        __m128 col0 = _mm_loadu_ps(m);
+        __m128 col1 = _mm_loadu_ps(m + 4);
+        __m128 col2 = _mm_loadu_ps(m + 8);
+        __m128 col3 = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(col0, col1, col2, col3);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 c = _mm_add_ps(
+            _mm_add_ps(col3, _mm_mul_ps(col0, _mm_set1_ps(cx))),
+            _mm_add_ps(_mm_mul_ps(col1, _mm_set1_ps(cy)), _mm_mul_ps(col2, _mm_set1_ps(cz))));
+        const __m128 e = _mm_add_ps(
+            _mm_mul_ps(_mm_andnot_ps(sign, col0), _mm_set1_ps(ex)),
+            _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, col1), _mm_set1_ps(ey)),
+                       _mm_mul_ps(_mm_andnot_ps(sign, col2), _mm_set1_ps(ez))));
+        float min[4];
+        float max[4];
+        _mm_storeu_ps(min, _mm_sub_ps(c, e));
+        _mm_storeu_ps(max, _mm_add_ps(c, e));
+#elif defined(AFFINE_NEON)
+        const float cols[16] = {
+            m[0], m[4], m[8],  0.0f, //
+            m[1], m[5], m[9],  0.0f, //
+            m[2], m[6], m[10], 0.0f, //
+            m[3], m[7], m[11], 0.0f, //
+        };
+        const float32x4_t col0 = vld1q_f32(cols);
+        const float32x4_t col1 = vld1q_f32(cols + 4);
+        const float32x4_t col2 = vld1q_f32(cols + 8);
+        const float32x4_t col3 = vld1q_f32(cols + 12);
+        const float32x4_t c = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(col3, col0, cx), col1, cy),
+                                          col2, cz);
+        const float32x4_t e = vmlaq_n_f32(
+            vmlaq_n_f32(vmulq_n_f32(vabsq_f32(col0), ex), vabsq_f32(col1), ey), vabsq_f32(col2),
+            ez);
+        float min[4];
+        float max[4];
+        vst1q_f32(min, vsubq_f32(c, e));
+        vst1q_f32(max, vaddq_f32(c, e));
+#else
+        const float c[3] = {cx, cy, cz};
+        const float e[3] = {ex, ey, ez};
+        float min[3];
+        float max[3];
+        for (int row = 0; row < 3; ++row) {
+            const float *r = m + row * 4;
+            const float center = r[0] * c[0] + r[1] * c[1] + r[2] * c[2] + r[3];
+            const float extent = std::fabs(r[0]) * e[0] + std::fabs(r[1]) * e[1]
+                                 + std::fabs(r[2]) * e[2];
+            min[row] = center - extent;
+            max[row] = center + extent;
+        }
+#endif
+        std::memcpy(w, min, 3 * sizeof(float));
+        std::memcpy(w + 3, max, 3 * sizeof(float));
+    }
+}
+
+void translation(const float offset[3], float out[12])
+{
+    const float m[12] = {
+        1.0f, 0.0f, 0.0f, offset[0], //
+        0.0f, 1.0f, 0.0f, offset[1], //
+        0.0f, 0.0f, 1.0f, offset[2], //
+    };
+    std::memcpy(out, m, sizeof(m));
+}
+
+void rotation(const float axis[3], const float radians, const float pivot[3], float out[12])
+{
+    const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (length == 0.0f) {
+        const float zero[3] = {};
+        translation(zero, out);
+        return;
+    }
+    const float x = axis[0] / length;
+    const float y = axis[1] / length;
+    const float z = axis[2] / length;
+    const float c = std::cos(radians);
+    const float s = std::sin(radians);
+    const float t = 1.0f - c;
+    // rodrigues, then move the pivot back to where it started
+    const float r[9] = {
+        t * x * x + c,     t * x * y - s * z, t * x * z + s * y, //
+        t * x * y + s * z, t * y * y + c,     t * y * z - s * x, //
+        t * x * z - s * y, t * y * z + s * x, t * z * z + c,     //
+    };
+    for (int row = 0; row < 3; ++row) {
+        out[row * 4 + 0] = r[row * 3 + 0];
+        out[row * 4 + 1] = r[row * 3 + 1];
+        out[row * 4 + 2] = r[row * 3 + 2];
+        out[row * 4 + 3] = pivot[row] - (r[row * 3 + 0] * pivot[0] + r[row * 3 + 1] * pivot[1]
+                                         + r[row * 3 + 2] * pivot[2]);
+    }
+}
+
+void scaling(const float factor, const float pivot[3], float out[12])
+{
+    const float m[12] = {
+        factor, 0.0f,   0.0f,   pivot[0] * (1.0f - factor), //
+        0.0f,   factor, 0.0f,   pivot[1] * (1.0f - factor), //
+        0.0f,   0.0f,   factor, pivot[2] * (1.0f - factor), //
+    };
+    std::memcpy(out, m, sizeof(m));
+}
+
+} // namespace affine
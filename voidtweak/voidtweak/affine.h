@@ -0,0 +1,26 @@
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include <QtGlobal>
+
+// 3x4 row-major affine matrices, the same layout bwm::PODMatrix uses: the
+// first three columns are the linear part and the last one the translation
+namespace affine
+{
+
+// m = op * m for count matrices, stride is the distance between them in floats
+void apply(const float op[12], float *matrices, qsizetype count, qsizetype stride = 12);
+
+// world space box of each local box under its matrix, boxes are 6 floats laid out as
+// min xyz then max xyz and sit back to back, matrices use stride like apply
+void bounds(const float *matrices, const float *local, float *world, qsizetype count,
+            qsizetype stride = 12);
+
+void translation(const float offset[3], float out[12]);
+// rotation around axis through pivot, axis does not need to be normalized
+void rotation(const float axis[3], float radians, const float pivot[3], float out[12]);
+void scaling(float factor, const float pivot[3], float out[12]);
+
+} // namespace affine
+
+#endif // AFFINE_H
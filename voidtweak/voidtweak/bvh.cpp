@@ -0,0 +1,255 @@
+#include "bvh.h"
+
+#include <QVarLengthArray>
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#define BVH_LEAF_SIZE 4
+
+namespace
+{
+
+bool overlaps(const Bvh::Box &a, const Bvh::Box &b)
+{
+    return a.min[0] <= b.max[0] && a.max[0] >= b.min[0] && a.min[1] <= b.max[1]
+           && a.max[1] >= b.min[1] && a.min[2] <= b.max[2] && a.max[2] >= b.min[2];
+}
+
+float distance2(const Bvh::Box &box, const float point[3])
+{
+    float d = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+        const float v = qMax(qMax(box.min[k] - point[k], point[k] - box.max[k]), 0.0f);
+        d += v * v;
+    }
+    return d;
+}
+
+// slab test, t is where the ray enters the box or 0 if it starts inside
+bool hit(const Bvh::Box &box, const float origin[3], const float inverse[3], float &t)
+{
+    float tNear = 0.0f;
+    float tFar = FLT_MAX;
+    for (int k = 0; k < 3; ++k) {
+        float t0 = (box.min[k] - origin[k]) * inverse[k];
+        float t1 = (box.max[k] - origin[k]) * inverse[k];
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tNear = qMax(tNear, t0);
+        tFar = qMin(tFar, t1);
+        if (tNear > tFar) {
+            return false;
+        }
+    }
+    t = tNear;
+    return true;
+}
+
+} // namespace
+
+void Bvh::build(const QList<Box> &boxes)
+{
+    clear();
+    m_boxes = boxes;
+    m_items.reserve(boxes.count());
+    for (qsizetype i = 0; i < boxes.count(); ++i) {
+        const Box &b = boxes[i];
+        if (b.min[0] <= b.max[0] && b.min[1] <= b.max[1] && b.min[2] <= b.max[2]) {
+            m_items.append(static_cast<quint32>(i));
+        }
+    }
+    if (m_items.isEmpty()) {
+        return;
+    }
+    m_nodes.reserve(2 * m_items.count() / BVH_LEAF_SIZE + 1);
+    buildNode(0, static_cast<quint32>(m_items.count()));
+}
+
+void Bvh::clear()
+{
+    m_nodes.clear();
+    m_boxes.clear();
+    m_items.clear();
+}
+
+quint32 Bvh::buildNode(const quint32 first, const quint32 count)
+{
+    const quint32 index = static_cast<quint32>(m_nodes.count());
+    Node node{{{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}}, first, count, 0};
+    float cmin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float cmax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (quint32 i = first; i < first + count; ++i) {
+        const Box &b = m_boxes[m_items[i]];
+        for (int k = 0; k < 3; ++k) {
+            node.box.min[k] = qMin(node.box.min[k], b.min[k]);
+            node.box.max[k] = qMax(node.box.max[k], b.max[k]);
+            const float c = b.min[k] + b.max[k];
+            cmin[k] = qMin(cmin[k], c);
+            cmax[k] = qMax(cmax[k], c);
+        }
+    }
+    m_nodes.append(node);
+    if (count <= BVH_LEAF_SIZE) {
+        return index;
+    }
+
+    // median split along whichever axis the centres spread over the most
+    int axis = 0;
+    for (int k = 1; k < 3; ++k) {
+        if (cmax[k] - cmin[k] > cmax[axis] - cmin[axis]) {
+            axis = k;
+        }
+    }
+    const quint32 half = count / 2;
+    const auto begin = m_items.begin() + first;
+    std::nth_element(begin, begin + half, begin + count, [this, axis](quint32 a, quint32 b) {
+        return m_boxes[a].min[axis] + m_boxes[a].max[axis]
+               < m_boxes[b].min[axis] + m_boxes[b].max[axis];
+    });
+    m_nodes[index].count = 0;
+    buildNode(first, half);
+    const quint32 right = buildNode(first + half, count - half);
+    m_nodes[index].right = right;
+    return index;
+}
+
+QList<quint32> Bvh::inBox(const Box &box) const
+{
+    QList<quint32> result;
+    if (isEmpty()) {
+        return result;
+    }
+    QVarLengthArray<quint32, 64> stack{0};
+    while (!stack.isEmpty()) {
+        const quint32 index = stack.last();
+        stack.removeLast();
+        const Node &node = m_nodes[index];
+        if (!overlaps(node.box, box)) {
+            continue;
+        }
+        if (node.count) {
+            for (quint32 i = node.first; i < node.first + node.count; ++i) {
+                if (overlaps(m_boxes[m_items[i]], box)) {
+                    result.append(m_items[i]);
+                }
+            }
+        } else {
+            stack.append(node.right);
+            stack.append(index + 1);
+        }
+    }
+    return result;
+}
+
+QList<quint32> Bvh::inSphere(const float center[3], const float radius) const
+{
+    QList<quint32> result;
+    if (isEmpty()) {
+        return result;
+    }
+    const float r2 = radius * radius;
+    QVarLengthArray<quint32, 64> stack{0};
+    while (!stack.isEmpty()) {
+        const quint32 index = stack.last();
+        stack.removeLast();
+        const Node &node = m_nodes[index];
+        if (distance2(node.box, center) > r2) {
+            continue;
+        }
+        if (node.count) {
+            for (quint32 i = node.first; i < node.first + node.count; ++i) {
+                if (distance2(m_boxes[m_items[i]], center) <= r2) {
+                    result.append(m_items[i]);
+                }
+            }
+        } else {
+            stack.append(node.right);
+            stack.append(index + 1);
+        }
+    }
+    return result;
+}
+
+QList<quint32> Bvh::onRay(const float origin[3], const float direction[3]) const
+{
+    QList<quint32> result;
+    if (isEmpty()) {
+        return result;
+    }
+    // a zero component gives an infinite inverse, which the slab test handles
+    const float inverse[3] = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+    std::vector<std::pair<float, quint32>> hits;
+    QVarLengthArray<quint32, 64> stack{0};
+    float t;
+    while (!stack.isEmpty()) {
+        const quint32 index = stack.last();
+        stack.removeLast();
+        const Node &node = m_nodes[index];
+        if (!hit(node.box, origin, inverse, t)) {
+            continue;
+        }
+        if (node.count) {
+            for (quint32 i = node.first; i < node.first + node.count; ++i) {
+                if (hit(m_boxes[m_items[i]], origin, inverse, t)) {
+                    hits.emplace_back(t, m_items[i]);
+                }
+            }
+        } else {
+            stack.append(node.right);
+            stack.append(index + 1);
+        }
+    }
+    std::sort(hits.begin(), hits.end());
+    result.reserve(static_cast<qsizetype>(hits.size()));
+    for (const auto &h : hits) {
+        result.append(h.second);
+    }
+    return result;
+}
+
+QList<quint32> Bvh::nearest(const float point[3], const int k) const
+{
+    QList<quint32> result;
+    if (isEmpty() || k <= 0) {
+        return result;
+    }
+    // best first: always open the closest node, stop once it is further away
+    // than the k-th best item found so far
+    using Candidate = std::pair<float, quint32>;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> open;
+    std::priority_queue<Candidate> best;
+    open.emplace(distance2(m_nodes[0].box, point), 0);
+    while (!open.empty()) {
+        const auto [d, index] = open.top();
+        open.pop();
+        if (static_cast<int>(best.size()) == k && d > best.top().first) {
+            break;
+        }
+        const Node &node = m_nodes[index];
+        if (node.count) {
+            for (quint32 i = node.first; i < node.first + node.count; ++i) {
+                const float di = distance2(m_boxes[m_items[i]], point);
+                if (static_cast<int>(best.size()) < k) {
+                    best.emplace(di, m_items[i]);
+                } else if (di < best.top().first) {
+                    best.pop();
+                    best.emplace(di, m_items[i]);
+                }
+            }
+        } else {
+            open.emplace(distance2(m_nodes[index + 1].box, point), index + 1);
+            open.emplace(distance2(m_nodes[node.right].box, point), node.right);
+        }
+    }
+    result.resize(static_cast<qsizetype>(best.size()));
+    for (auto i = result.size() - 1; i >= 0; --i) {
+        result[i] = best.top().second;
+        best.pop();
+    }
+    return result;
+}
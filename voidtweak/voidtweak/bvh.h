@@ -0,0 +1,47 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <QList>
+#include <QtGlobal>
+
+// bounding volume hierarchy over a fixed set of axis aligned boxes, items are
+// referred to by their index in the list the tree was built from
+class Bvh
+{
+  public:
+    struct Box {
+        float min[3];
+        float max[3];
+    };
+
+    Bvh() = default;
+
+    // boxes with min > max on any axis are left out of the tree
+    void build(const QList<Box> &boxes);
+    void clear();
+    bool isEmpty() const { return m_nodes.isEmpty(); }
+
+    QList<quint32> inBox(const Box &box) const;
+    QList<quint32> inSphere(const float center[3], float radius) const;
+    // every box the ray passes through, nearest entry point first
+    QList<quint32> onRay(const float origin[3], const float direction[3]) const;
+    // up to k boxes closest to point, nearest first
+    QList<quint32> nearest(const float point[3], int k) const;
+
+  private:
+    // inner nodes have count 0, their left child follows them directly
+    struct Node {
+        Box box;
+        quint32 first;
+        quint32 count;
+        quint32 right;
+    };
+
+    quint32 buildNode(quint32 first, quint32 count);
+
+    QList<Node> m_nodes;
+    QList<Box> m_boxes;
+    QList<quint32> m_items;
+};
+
+#endif // BVH_H
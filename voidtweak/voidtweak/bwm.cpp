@@ -4,6 +4,17 @@
 #include <QDataStream>
 #include <QDebug>
 #include <QIODevice>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <numeric>
+
+#include "affine.h"
+
+#define MATRIX_SIZE (12 * 4)
+#define MESH_SIZE (10 * 4 + 1)
+#define OBJECT_MIN_SIZE (3 * 4 + 1 + 4 + 4)
+#define INSTANCE_SIZE (6 * 4 + 4 + 2)
 
 namespace bwm
 {
@@ -48,63 +59,294 @@ QString maxVert(const PODInstance &i)
     return u"%1,%2,%3"_qs.arg(i.max[0]).arg(i.max[1]).arg(i.max[2]);
 }
 
-Matrix::Matrix(const PODMatrix &data, QObject *parent)
+Store::Store(const QList<PODObject> &objects, const QList<Bounds> &meshBounds,
+             const Groups &groups, QObject *parent)
     : QObject(parent)
-    , m_data(data)
+    , m_groups(groups)
 {
+    quint32 count = 0;
+    for (const auto &o : objects) {
+        count = qMax(count, o.indexStart + static_cast<quint32>(o.matrices.count()));
+    }
+    // slots no object owns stay zeroed and never show up in the UI
+    m_matrices.resize(count);
+    m_instances.resize(count);
+    m_local.resize(count, {{1, 1, 1}, {0, 0, 0}});
+    m_dirtyMatrices.resize(count);
+    m_dirtyInstances.resize(count);
+    m_owners.resize(count, -1);
+    m_objects.reserve(objects.count());
+    for (const auto &o : objects) {
+        std::fill_n(m_owners.begin() + o.indexStart, o.matrices.count(),
+                    static_cast<qint32>(m_objects.count()));
+        m_objects.append(o);
+        m_objects.last().matrices.clear();
+        m_objects.last().instances.clear();
+        std::copy(o.matrices.cbegin(), o.matrices.cend(), m_matrices.begin() + o.indexStart);
+        std::copy(o.instances.cbegin(), o.instances.cend(), m_instances.begin() + o.indexStart);
+        if (o.meshIndex < meshBounds.count()) {
+            std::fill_n(m_local.begin() + o.indexStart, o.matrices.count(),
+                        meshBounds[o.meshIndex]);
+        }
+    }
 }
-// clang-format off
-void Matrix::setX1(const float &v) {if (v != m_data.values[ 0]) {m_data.values[ 0] = v; emit dataChanged();}}
-void Matrix::setX2(const float &v) {if (v != m_data.values[ 1]) {m_data.values[ 1] = v; emit dataChanged();}}
-void Matrix::setX3(const float &v) {if (v != m_data.values[ 2]) {m_data.values[ 2] = v; emit dataChanged();}}
-void Matrix::setX4(const float &v) {if (v != m_data.values[ 3]) {m_data.values[ 3] = v; emit dataChanged();}}
-void Matrix::setY1(const float &v) {if (v != m_data.values[ 4]) {m_data.values[ 4] = v; emit dataChanged();}}
-void Matrix::setY2(const float &v) {if (v != m_data.values[ 5]) {m_data.values[ 5] = v; emit dataChanged();}}
-void Matrix::setY3(const float &v) {if (v != m_data.values[ 6]) {m_data.values[ 6] = v; emit dataChanged();}}
-void Matrix::setY4(const float &v) {if (v != m_data.values[ 7]) {m_data.values[ 7] = v; emit dataChanged();}}
-void Matrix::setZ1(const float &v) {if (v != m_data.values[ 8]) {m_data.values[ 8] = v; emit dataChanged();}}
-void Matrix::setZ2(const float &v) {if (v != m_data.values[ 9]) {m_data.values[ 9] = v; emit dataChanged();}}
-void Matrix::setZ3(const float &v) {if (v != m_data.values[10]) {m_data.values[10] = v; emit dataChanged();}}
-void Matrix::setZ4(const float &v) {if (v != m_data.values[11]) {m_data.values[11] = v; emit dataChanged();}}
-// clang-format on
-
-Instance::Instance(const PODInstance &data, QObject *parent)
-    : QObject(parent)
-    , m_data(data)
+
+void Store::setMatrixValue(const quint32 index, const int k, const float v)
 {
+    if (v == m_matrices.at(index).values[k]) {
+        return;
+    }
+    m_matrices[index].values[k] = v;
+    updateBounds({index});
+    markDirty({index});
+    dropHistory();
+    emit changed();
 }
-// clang-format off
-void Instance::setMinX(const float &v) {if (v != m_data.min[0]) {m_data.min[0] = v; emit dataChanged();}}
-void Instance::setMinY(const float &v) {if (v != m_data.min[1]) {m_data.min[1] = v; emit dataChanged();}}
-void Instance::setMinZ(const float &v) {if (v != m_data.min[2]) {m_data.min[2] = v; emit dataChanged();}}
-void Instance::setMaxX(const float &v) {if (v != m_data.max[0]) {m_data.max[0] = v; emit dataChanged();}}
-void Instance::setMaxY(const float &v) {if (v != m_data.max[1]) {m_data.max[1] = v; emit dataChanged();}}
-void Instance::setMaxZ(const float &v) {if (v != m_data.max[2]) {m_data.max[2] = v; emit dataChanged();}}
-// clang-format on
-
-Object::Object(const PODObject &data, QObject *parent)
-    : QObject(parent)
-    , m_data(data)
+
+void Store::setInstanceValue(const quint32 index, const int k, const float v)
+{
+    float &value = k < 3 ? m_instances[index].min[k] : m_instances[index].max[k - 3];
+    if (v == value) {
+        return;
+    }
+    value = v;
+    m_dirtyInstances.setBit(index);
+    dropHistory();
+    emit changed();
+}
+
+void Store::dropHistory()
+{
+    // undo would put back snapshots taken before the edit and redo would apply its op
+    // to values it never saw, neither lands where the user expects
+    m_undo.clear();
+    m_redo.clear();
+}
+
+QList<float> Store::gather(const QList<quint32> &indexes) const
+{
+    QList<float> values(indexes.count() * 12);
+    float *out = values.data();
+    for (const auto i : indexes) {
+        std::copy(m_matrices.at(i).values, m_matrices.at(i).values + 12, out);
+        out += 12;
+    }
+    return values;
+}
+
+void Store::scatter(const QList<quint32> &indexes, const QList<float> &values)
+{
+    const float *in = values.constData();
+    for (const auto i : indexes) {
+        std::copy(in, in + 12, m_matrices[i].values);
+        in += 12;
+    }
+}
+
+void Store::markDirty(const QList<quint32> &indexes)
+{
+    // instance bounds follow their matrix, so both get written
+    for (const auto i : indexes) {
+        m_dirtyMatrices.setBit(i);
+        m_dirtyInstances.setBit(i);
+    }
+}
+
+void Store::updateBounds(const QList<quint32> &indexes)
+{
+    // instances without a readable mesh keep whatever bounds they had
+    QList<quint32> known;
+    known.reserve(indexes.count());
+    for (const auto i : indexes) {
+        const Bounds &b = m_local.at(i);
+        if (b.min[0] <= b.max[0] && b.min[1] <= b.max[1] && b.min[2] <= b.max[2]) {
+            known.append(i);
+        }
+    }
+    if (known.isEmpty()) {
+        return;
+    }
+    QList<float> local(known.count() * 6);
+    float *out = local.data();
+    for (const auto i : known) {
+        out = std::copy(m_local.at(i).min, m_local.at(i).min + 3, out);
+        out = std::copy(m_local.at(i).max, m_local.at(i).max + 3, out);
+    }
+    QList<float> world(known.count() * 6);
+    affine::bounds(gather(known).constData(), local.constData(), world.data(), known.count());
+    const float *in = world.constData();
+    for (const auto i : known) {
+        std::copy(in, in + 3, m_instances[i].min);
+        std::copy(in + 3, in + 6, m_instances[i].max);
+        in += 6;
+    }
+}
+
+void Store::transform(const QList<quint32> &indexes, const float op[12])
+{
+    QList<quint32> valid;
+    valid.reserve(indexes.count());
+    for (const auto i : indexes) {
+        if (static_cast<qsizetype>(i) < m_matrices.count()) {
+            valid.append(i);
+        }
+    }
+    if (valid.isEmpty()) {
+        return;
+    }
+    // run the kernel over a packed copy, the PODMatrix offsets break up the stride
+    Batch batch{valid, {}, gather(valid), {}};
+    std::copy(op, op + 12, batch.op);
+    batch.instances.reserve(valid.count());
+    for (const auto i : valid) {
+        batch.instances.append(m_instances.at(i));
+    }
+    QList<float> values = batch.before;
+    affine::apply(op, values.data(), valid.count());
+    scatter(valid, values);
+    updateBounds(valid);
+    markDirty(valid);
+    m_undo.append(batch);
+    m_redo.clear();
+    emit changed();
+}
+
+void Store::undo()
+{
+    if (m_undo.isEmpty()) {
+        return;
+    }
+    Batch batch = m_undo.takeLast();
+    scatter(batch.indexes, batch.before);
+    // the original bounds may not be what updateBounds would give, put them back as is
+    for (qsizetype k = 0; k < batch.indexes.count(); ++k) {
+        m_instances[batch.indexes[k]] = batch.instances[k];
+    }
+    // stays dirty, a save in between may have written the transformed values
+    m_redo.append(batch);
+    emit changed();
+}
+
+void Store::redo()
+{
+    if (m_redo.isEmpty()) {
+        return;
+    }
+    Batch batch = m_redo.takeLast();
+    QList<float> values = gather(batch.indexes);
+    batch.before = values;
+    for (qsizetype k = 0; k < batch.indexes.count(); ++k) {
+        batch.instances[k] = m_instances.at(batch.indexes[k]);
+    }
+    affine::apply(batch.op, values.data(), batch.indexes.count());
+    scatter(batch.indexes, values);
+    updateBounds(batch.indexes);
+    markDirty(batch.indexes);
+    m_undo.append(batch);
+    emit changed();
+}
+
+PODObject Store::pod(const qsizetype object, const bool dirtyOnly) const
+{
+    PODObject o = m_objects.at(object);
+    for (quint32 i = o.indexStart; i < o.indexEnd && i < m_matrices.count(); ++i) {
+        if (!dirtyOnly || m_dirtyMatrices.testBit(i)) {
+            o.matrices.append(m_matrices.at(i));
+        }
+        if (!dirtyOnly || m_dirtyInstances.testBit(i)) {
+            o.instances.append(m_instances.at(i));
+        }
+    }
+    return o;
+}
+
+Groups::Groups(const Level &level)
 {
-    for (const auto &m : m_data.matrices) {
-        m_matrices.append(new Matrix(m, this));
+    const qsizetype instanceCount = level.instances.count();
+    m_starts.append(0);
+    for (int i = 0; i < 3; ++i) {
+        append(DarkVision, i + 1, level.darkVision[i], instanceCount);
     }
-    for (const auto &i : m_data.instances) {
-        m_instances.append(new Instance(i, this));
+    for (const auto &g : level.lodGroups) {
+        append(Lod, g.first, g.second, instanceCount);
+    }
+    for (const auto &g : level.groups) {
+        append(Plain, 0, g, instanceCount);
+    }
+    append(Physics, 0, level.physics, instanceCount);
+
+    // reverse table, groups of every instance packed the same way as the members
+    m_instanceStarts.resize(instanceCount + 1, 0);
+    for (const quint32 i : qAsConst(m_members)) {
+        ++m_instanceStarts[i + 1];
+    }
+    std::partial_sum(m_instanceStarts.begin(), m_instanceStarts.end(), m_instanceStarts.begin());
+    m_instanceGroups.resize(m_instanceStarts.last());
+    QList<qsizetype> fill(m_instanceStarts.cbegin(), m_instanceStarts.cend() - 1);
+    m_layers.resize(instanceCount, 0);
+    for (qsizetype g = 0; g < count(); ++g) {
+        for (qsizetype m = m_starts[g]; m < m_starts[g + 1]; ++m) {
+            const quint32 i = m_members[m];
+            m_instanceGroups[fill[i]++] = g;
+            if (m_kinds[g] == DarkVision && !m_layers[i]) {
+                m_layers[i] = static_cast<quint8>(m_labels[g]);
+            }
+        }
     }
 }
 
-PODObject Object::pod()
+void Groups::append(const Kind kind, const quint32 label, const Group &members,
+                    const qsizetype instanceCount)
 {
-    m_data.matrices.clear();
-    for (const auto m : m_matrices) {
-        m_data.matrices.append(m->pod());
+    m_kinds.append(kind);
+    m_labels.append(label);
+    // parseLevel already drops these, a hand built level must not size the bitset either
+    const qsizetype start = m_members.count();
+    for (const quint32 i : members) {
+        if (i < instanceCount) {
+            m_members.append(i);
+        }
     }
-    m_data.instances.clear();
-    for (const auto i : m_instances) {
-        m_data.instances.append(i->pod());
+    m_starts.append(m_members.count());
+    QBitArray bits;
+    quint32 first = 0;
+    if (m_members.count() > start) {
+        const auto [lo, hi] = std::minmax_element(m_members.cbegin() + start, m_members.cend());
+        first = *lo;
+        bits.resize(static_cast<qsizetype>(*hi - *lo) + 1);
+        for (auto it = m_members.cbegin() + start; it != m_members.cend(); ++it) {
+            bits.setBit(*it - first);
+        }
     }
-    return m_data;
+    m_firsts.append(first);
+    m_bits.append(bits);
+}
+
+QList<quint32> Groups::instances(const qsizetype group) const
+{
+    return m_members.sliced(m_starts.at(group), m_starts.at(group + 1) - m_starts.at(group));
+}
+
+bool Groups::contains(const qsizetype group, const quint32 instance) const
+{
+    const QBitArray &bits = m_bits.at(group);
+    const quint32 first = m_firsts.at(group);
+    return instance >= first && instance - first < static_cast<quint32>(bits.size())
+           && bits.testBit(instance - first);
+}
+
+QList<qsizetype> Groups::groupsOf(const quint32 instance) const
+{
+    if (instance >= m_layers.count()) {
+        return {};
+    }
+    return m_instanceGroups.sliced(m_instanceStarts[instance],
+                                   m_instanceStarts[instance + 1] - m_instanceStarts[instance]);
+}
+
+int Groups::darkVisionLayer(const quint32 instance) const
+{
+    return instance < m_layers.count() ? m_layers[instance] : 0;
 }
 
 void setScale(const float &scale, PODMatrix *matrix)
@@ -120,19 +362,310 @@ void setScale(const float &scale, PODMatrix *matrix)
     matrix->values[10] = scale;
 }
 
-QString parse(const QByteArray &input, QList<PODObject> &objects)
+namespace
+{
+
+// bounds checked little-endian reads straight out of the input, anything that
+// would run past the end flips ok and returns zeroes from then on
+class Reader
+{
+  public:
+    explicit Reader(QByteArrayView input)
+        : m_input(input)
+    {
+    }
+    qint64 pos() const { return m_pos; }
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_pos >= m_input.size(); }
+    qint64 remaining() const { return m_input.size() - m_pos; }
+    // view of the next n bytes, null if they are not all there
+    QByteArrayView take(const qint64 n)
+    {
+        if (!m_ok || n < 0 || n > remaining()) {
+            m_ok = false;
+            return {};
+        }
+        const QByteArrayView result = m_input.sliced(m_pos, n);
+        m_pos += n;
+        return result;
+    }
+    template <typename T> T read()
+    {
+        const QByteArrayView bytes = take(sizeof(T));
+        return bytes.isNull() ? T() : qFromLittleEndian<T>(bytes.data());
+    }
+    // n values of T in one go, the whole span is checked before anything is read
+    template <typename T> bool readArray(T *dst, const qint64 n)
+    {
+        const QByteArrayView bytes = take(n * qint64(sizeof(T)));
+        if (bytes.isNull()) {
+            return false;
+        }
+        qFromLittleEndian<T>(bytes.data(), n, dst);
+        return true;
+    }
+    bool readGroup(Group &group, const quint32 n)
+    {
+        if (qint64(n) * 4 > remaining()) {
+            m_ok = false;
+            return false;
+        }
+        group.resize(n);
+        return readArray(group.data(), n);
+    }
+
+  private:
+    QByteArrayView m_input;
+    qint64 m_pos = 0;
+    bool m_ok = true;
+};
+
+} // namespace
+
+QString parseLevel(QByteArrayView input, Level &level)
+{
+    level = {};
+    Reader r(input);
+    const QByteArray magic = r.take(4).toByteArray();
+    if (magic != "BWM1") {
+        return u"Bad magic: %1"_qs.arg(magic);
+    }
+    const auto v1 = r.read<quint16>();
+    const auto v2 = r.read<quint16>();
+    const auto v3 = r.read<quint32>();
+    if (v1 != 21 || v2 != 1 || v3 != 2) {
+        return u"Bad version info: %1.%2.%3"_qs.arg(v1).arg(v2).arg(v3);
+    }
+
+    // vertex sections stay as views, nothing here needs them decoded
+    level.vertexCoords = r.take(r.read<quint32>());
+    level.vertexData = r.take(r.read<quint32>());
+    level.vertexIndices = r.take(r.read<quint32>());
+    if (!r.ok()) {
+        return u"Vertex sections run past the end of the file!"_qs;
+    }
+
+    const quint32 vmSize = r.read<quint32>();
+    if (vmSize % MATRIX_SIZE || vmSize > r.remaining()) {
+        return u"Bad matrix section size %1"_qs.arg(vmSize);
+    }
+    level.matrices.resize(vmSize / MATRIX_SIZE);
+    for (auto &m : level.matrices) {
+        m.offset = r.pos();
+        r.readArray(m.values, 12);
+    }
+
+    // no BWM file in Dishonored 2 has anything in this section
+    const quint32 vuSize = r.read<quint32>();
+    r.take(vuSize);
+    if (vuSize) {
+        qWarning() << "Skipped" << vuSize << "bytes of unknown vertex data";
+    }
+
+    const quint32 meshCount = r.read<quint32>();
+    if (qint64(meshCount) * MESH_SIZE > r.remaining()) {
+        return u"Bad mesh count %1"_qs.arg(meshCount);
+    }
+    level.meshes.resize(meshCount);
+    for (quint32 i = 0; i < meshCount; ++i) {
+        PODMesh &m = level.meshes[i];
+        m.offset = r.pos();
+        quint32 fields[10];
+        r.readArray(fields, 10);
+        m.unk1 = fields[0];
+        m.vco = fields[1];
+        m.vcs = fields[2];
+        m.vdo = fields[3];
+        m.vds = fields[4];
+        m.unk2 = fields[5];
+        m.vio = fields[6];
+        m.vic = fields[7];
+        m.vc = fields[8];
+        m.unk3 = fields[9];
+        m.unk4 = r.read<quint8>();
+        if (m.vds != 20) {
+            return u"Mesh %1 has bad vertex data stride %2"_qs.arg(i).arg(m.vds);
+        }
+        if (m.unk1 != 2) {
+            return u"Mesh %1 has bad unk1 %2"_qs.arg(i).arg(m.unk1);
+        }
+        if (m.unk2 != 0x12345678) {
+            return u"Mesh %1 has bad unk2 %2"_qs.arg(i).arg(m.unk2);
+        }
+        if (m.unk3 != 3) {
+            return u"Mesh %1 has bad unk3 %2"_qs.arg(i).arg(m.unk3);
+        }
+        if (m.unk4 != 1) {
+            return u"Mesh %1 has bad unk4 %2"_qs.arg(i).arg(m.unk4);
+        }
+    }
+
+    const quint32 objectCount = r.read<quint32>();
+    if (qint64(objectCount) * OBJECT_MIN_SIZE > r.remaining()) {
+        return u"Bad object count %1"_qs.arg(objectCount);
+    }
+    level.objects.resize(objectCount);
+    for (auto &o : level.objects) {
+        o.offset = r.pos();
+        o.indexStart = r.read<quint32>();
+        o.indexEnd = r.read<quint32>();
+        o.meshIndex = r.read<quint32>();
+        o.isFlipped = r.read<quint8>();
+        const QByteArrayView path = r.take(r.read<quint32>());
+        o.materialPath = QString::fromUtf8(path);
+        o.lod = r.read<quint32>();
+    }
+    if (!r.ok()) {
+        return u"Objects run past the end of the file!"_qs;
+    }
+
+    const quint32 instanceCount = r.read<quint32>();
+    if (qint64(instanceCount) * INSTANCE_SIZE > r.remaining()) {
+        return u"Bad instance count %1"_qs.arg(instanceCount);
+    }
+    level.instances.resize(instanceCount);
+    for (quint32 i = 0; i < instanceCount; ++i) {
+        PODInstance &ins = level.instances[i];
+        ins.offset = r.pos();
+        float bounds[6];
+        r.readArray(bounds, 6);
+        std::copy(bounds, bounds + 3, ins.min);
+        std::copy(bounds + 3, bounds + 6, ins.max);
+        ins.unk1 = r.read<quint32>();
+        ins.unk2 = r.read<qint16>();
+        if (ins.unk2 != -1) {
+            return u"Instance %1 has bad unk2 %2"_qs.arg(i).arg(ins.unk2);
+        }
+    }
+    for (const auto &o : qAsConst(level.objects)) {
+        if (o.indexStart > o.indexEnd || o.indexEnd > instanceCount
+            || o.indexEnd > level.matrices.count()) {
+            return u"%1 has instances out of range"_qs.arg(matName(o));
+        }
+    }
+
+    quint32 dvCount[4];
+    r.readArray(dvCount, 4);
+    for (int i = 0; i < 3; ++i) {
+        r.readGroup(level.darkVision[i], dvCount[i]);
+    }
+    r.take(qint64(dvCount[3]) * 4);
+    if (dvCount[3]) {
+        qWarning() << "Skipped" << dvCount[3] << "indexes in idx4!";
+    }
+    if (!r.ok() || r.atEnd()) {
+        return u"EOF reached before g1!"_qs;
+    }
+
+    const quint32 g1Count = r.read<quint32>();
+    if (qint64(g1Count) * 8 > r.remaining()) {
+        return u"Bad g1 count %1"_qs.arg(g1Count);
+    }
+    level.lodGroups.resize(g1Count);
+    for (auto &g : level.lodGroups) {
+        g.first = r.read<quint32>();
+        r.readGroup(g.second, r.read<quint32>());
+    }
+    if (!r.ok() || r.atEnd()) {
+        return u"EOF reached before g2!"_qs;
+    }
+
+    const quint32 g2Count = r.read<quint32>();
+    if (qint64(g2Count) * 4 > r.remaining()) {
+        return u"Bad g2 count %1"_qs.arg(g2Count);
+    }
+    level.groups.resize(g2Count);
+    for (auto &g : level.groups) {
+        r.readGroup(g, r.read<quint32>());
+    }
+    if (!r.ok() || r.atEnd()) {
+        return u"EOF reached before idx5!"_qs;
+    }
+
+    r.readGroup(level.physics, r.read<quint32>());
+    if (!r.ok()) {
+        return u"EOF reached in idx5!"_qs;
+    }
+
+    // members past the instance list can't be placed anywhere, drop them instead of
+    // trusting them as indexes later on
+    qsizetype dropped = 0;
+    const auto validate = [&](Group &g) {
+        dropped += g.removeIf([instanceCount](const quint32 i) { return i >= instanceCount; });
+    };
+    for (auto &g : level.darkVision) {
+        validate(g);
+    }
+    for (auto &g : level.lodGroups) {
+        validate(g.second);
+    }
+    for (auto &g : level.groups) {
+        validate(g);
+    }
+    validate(level.physics);
+    if (dropped) {
+        qWarning() << "Dropped" << dropped << "group members out of range!";
+    }
+    return {};
+}
+
+QList<Bounds> meshBounds(const Level &level)
+{
+    QList<Bounds> bounds(level.meshes.count(), {{1, 1, 1}, {0, 0, 0}});
+    QList<qsizetype> meshes(level.meshes.count());
+    std::iota(meshes.begin(), meshes.end(), 0);
+    Bounds *out = bounds.data();
+    QtConcurrent::blockingMap(meshes, [&](const qsizetype mi) {
+        const PODMesh &m = level.meshes[mi];
+        const qint64 length = qint64(m.vc) * 12;
+        if (m.vcs != 12 || !m.vc || m.vco + length > level.vertexCoords.size()) {
+            return;
+        }
+        QList<float> coords(qsizetype(m.vc) * 3);
+        qFromLittleEndian<float>(level.vertexCoords.data() + m.vco, coords.count(),
+                                 coords.data());
+        Bounds &b = out[mi];
+        std::copy(coords.cbegin(), coords.cbegin() + 3, b.min);
+        std::copy(coords.cbegin(), coords.cbegin() + 3, b.max);
+        for (qsizetype v = 3; v < coords.count(); v += 3) {
+            for (int k = 0; k < 3; ++k) {
+                b.min[k] = qMin(b.min[k], coords[v + k]);
+                b.max[k] = qMax(b.max[k], coords[v + k]);
+            }
+        }
+    });
+    return bounds;
+}
+
+QString parse(const QByteArray &input, QList<PODObject> &objects, QList<Bounds> *meshBounds,
+              Groups *groups)
+{
+    Level level;
+    const QString error = parseLevel(input, level);
+    if (!error.isEmpty()) {
+        return error;
+    }
+    if (meshBounds) {
+        *meshBounds = bwm::meshBounds(level);
+    }
+    if (groups) {
+        *groups = Groups(level);
+    }
+    objects = level.objects;
+    for (auto &o : objects) {
+        const qsizetype count = o.indexEnd - o.indexStart;
+        o.matrices = level.matrices.sliced(o.indexStart, count);
+        o.instances = level.instances.sliced(o.indexStart, count);
+    }
+    return {};
+}
+
+QString parseReference(const QByteArray &input, QList<PODObject> &objects)
 {
     if (input.first(4) != "BWM1") {
         return u"Bad magic:"_qs.arg(input.first(4));
     }
 
-    // GLTF components
-    QVariantList gBuffers;
-    QVariantList gBufferViews;
-    QVariantList gAccessors;
-    QVariantList gMeshes;
-    QVariantList gNodes;
-
     QDataStream stream(input);
     stream.setByteOrder(QDataStream::LittleEndian);
     stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
@@ -148,38 +681,13 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
 
     quint32 vcSize;
     stream >> vcSize;
-    auto vcOffset = stream.device()->pos();
     stream.skipRawData(vcSize);
-    // 3 float32 (x, y, z) coords per vertex
-    qInfo() << "Skipped" << vcSize << "bytes of vertex coords at" << Qt::hex << vcOffset;
-    gBufferViews.append(QVariantMap{
-        {u"buffer"_qs, 0},
-        {u"byteLength"_qs, vcSize},
-        {u"byteOffset"_qs, vcOffset},
-        {u"target"_qs, 34962},
-        {u"name"_qs, u"vertexCoords"_qs},
-    });
-
     quint32 vdSize;
     stream >> vdSize;
-    auto vdOffset = stream.device()->pos();
     stream.skipRawData(vdSize);
-    // 20 bytes of data per vertex (can some vertexes not have any data?)
-    qDebug() << "Skipped" << vdSize << "bytes of vertex data at" << Qt::hex << vdOffset;
-
     quint32 viSize;
     stream >> viSize;
-    auto viOffset = stream.device()->pos();
     stream.skipRawData(viSize);
-    // uint16 per index
-    qInfo() << "Skipped" << viSize << "bytes of vertex indexes at" << Qt::hex << viOffset;
-    gBufferViews.append(QVariantMap{
-        {u"buffer"_qs, 0},
-        {u"byteLength"_qs, viSize},
-        {u"byteOffset"_qs, viOffset},
-        {u"target"_qs, 34963},
-        {u"name"_qs, u"vertexIndices"_qs},
-    });
 
     quint32 vmSize;
     stream >> vmSize;
@@ -192,18 +700,10 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
             m.values[10] >> m.values[11];
         matrices.append(m);
     }
-    qDebug() << "Read" << matrices.count() << "matrices.";
 
-    // there is a section size value here, but no BWM file in Dishonored 2 has
-    // any data in this section.
     quint32 vuSize;
     stream >> vuSize;
-    auto vuOffset = stream.device()->pos();
     stream.skipRawData(vuSize);
-    if (vuSize) {
-        qWarning() << "Skipped" << vuSize << "bytes of unknown vertex data at" << Qt::hex
-                   << vuOffset;
-    }
 
     quint32 meshCount;
     stream >> meshCount;
@@ -229,35 +729,10 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
             return u"Mesh %1 has bad unk4 %2"_qs.arg(i).arg(m.unk4);
         }
         meshes.append(m);
-        const auto posIdx = gAccessors.count();
-        gAccessors.append(QVariantMap{
-            {u"bufferView"_qs, 0}, // vertex coords list is always the first buffer view
-            {u"componentType"_qs, 5126},
-            {u"type"_qs, u"VEC3"_qs},
-            {u"byteOffset"_qs, m.vco},
-            {u"count"_qs, m.vc},
-        });
-        const auto indicesIdx = gAccessors.count();
-        gAccessors.append(QVariantMap{
-            {u"bufferView"_qs, 1}, // indices list is always the second buffer view
-            {u"componentType"_qs, 5123},
-            {u"type"_qs, u"SCALAR"_qs},
-            {u"byteOffset"_qs, m.vio},
-            {u"count"_qs, m.vic},
-        });
-        gMeshes.append(QVariantMap{
-            {u"name"_qs, u"M%1"_qs.arg(i)},
-            {u"primitives"_qs, QVariantList{QVariantMap{
-                                   {u"attributes"_qs, QVariantMap{{u"POSITION"_qs, posIdx}}},
-                                   {u"indices"_qs, indicesIdx},
-                               }}},
-        });
-    }
-    qDebug() << "Read" << meshes.count() << "meshes.";
+    }
 
     quint32 objectCount;
     stream >> objectCount;
-    QMap<quint32, quint32> idxToObj;
     for (quint32 i = 0; i < objectCount; ++i) {
         PODObject o;
         o.offset = stream.device()->pos();
@@ -269,16 +744,11 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
         delete[] str;
         stream >> o.lod;
         objects.append(o);
-        for (quint32 ii = o.indexStart; ii < o.indexEnd; ++ii) {
-            idxToObj[ii] = i;
-        }
     }
-    qDebug() << "Read" << objects.count() << "objects.";
 
     quint32 instanceCount;
     stream >> instanceCount;
     QList<PODInstance> instances;
-    QList<QString> instanceNames;
     for (quint32 i = 0; i < instanceCount; ++i) {
         PODInstance ins;
         ins.offset = stream.device()->pos();
@@ -288,77 +758,47 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
             return u"Instance %1 has bad unk2 %2"_qs.arg(i).arg(ins.unk2);
         }
         instances.append(ins);
-        instanceNames.append(u"I%1"_qs.arg(i));
     }
-    qDebug() << "Read" << instances.count() << "instances.";
 
-    // TODO: what are all theses lists and groups of indexes for, they all seem
-    //       to be valid indexes for the list of instances/matrices
-    QSet<quint32> objs;
     quint32 idx1Count, idx2Count, idx3Count, idx4Count;
     stream >> idx1Count >> idx2Count >> idx3Count >> idx4Count;
     Group idx1, idx2, idx3;
     quint32 v;
-
-    // NOTE: appears to be material.options.rendering/darkVisionLayer = 1
     for (quint32 i = 0; i < idx1Count; ++i) {
         stream >> v;
         idx1.append(v);
-        instanceNames[v] = u"%1 dv1"_qs.arg(instanceNames[v]);
     }
-
-    // NOTE: appears to be material.options.rendering/darkVisionLayer = 2
     for (quint32 i = 0; i < idx2Count; ++i) {
         stream >> v;
         idx2.append(v);
-        instanceNames[v] = u"%1 dv2"_qs.arg(instanceNames[v]);
     }
-
-    // NOTE: appears to be material.options.rendering/darkVisionLayer = 3
     for (quint32 i = 0; i < idx3Count; ++i) {
         stream >> v;
         idx3.append(v);
-        instanceNames[v] = u"%1 dv3"_qs.arg(instanceNames[v]);
     }
-
-    // NOTE: never used, but i bet it is material.options.rendering/darkVisionLayer = 4
     stream.skipRawData(idx4Count * 4);
-    if (idx4Count) {
-        qWarning() << "Skipped" << idx4Count << "indexes in idx4!";
-    }
 
     if (stream.atEnd()) {
         return u"EOF reached before g1!"_qs;
     }
-
-    // NOTE: appears to be special distant objects that need to override normal
-    //       LOD/culling behaviour, like the ship you can see in the port far
-    //       below at the start of dunwall tower streets.
     quint32 g1Count;
     stream >> g1Count;
     QList<LabeledGroup> g1;
     for (quint32 i = 0; i < g1Count; ++i) {
         LabeledGroup g;
         stream >> g.first;
-        instanceNames[g.first] = u"%1 L"_qs.arg(instanceNames[g.first]);
         quint32 gCount;
         stream >> gCount;
-        const PODObject lo = objects[idxToObj[g.first]];
         for (quint32 gi = 0; gi < gCount; ++gi) {
             stream >> v;
             g.second.append(v);
-            objs.insert(idxToObj[v]);
-            instanceNames[v] = u"%1 l%2"_qs.arg(instanceNames[v]).arg(g.first);
         }
         g1.append(g);
-        objs.clear();
     }
 
     if (stream.atEnd()) {
         return u"EOF reached before g2!"_qs;
     }
-    // there is always at least 1 of these groups, often far more, they can be
-    // empty, but there are never any duplicate indexes
     quint32 g2Count;
     stream >> g2Count;
     QList<Group> g2;
@@ -369,26 +809,19 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
         for (quint32 gi = 0; gi < gCount; ++gi) {
             stream >> v;
             g.append(v);
-            objs.insert(idxToObj[v]);
-            instanceNames[v] = u"%1 g%2"_qs.arg(instanceNames[v]).arg(i);
         }
         g2.append(g);
-        objs.clear();
     }
 
     if (stream.atEnd()) {
         return u"EOF reached before idx5!"_qs;
     }
-
-    // TODO: used rarely, not much in common with members, all have m_PhysicsMaterial
-    //       set to env.<something> (metal, stone, dirt...)
     quint32 idx5Count;
     stream >> idx5Count;
     Group idx5;
     for (quint32 i = 0; i < idx5Count; ++i) {
         stream >> v;
         idx5.append(v);
-        instanceNames[v] = u"%1 idx5"_qs.arg(instanceNames[v]);
     }
 
     for (auto &o : objects) {
@@ -397,60 +830,6 @@ QString parse(const QByteArray &input, QList<PODObject> &objects)
             o.instances.append(instances[i]);
         }
     }
-
-    // write out gltf version of level
-    {
-        // pack these at the end so we can see group membership
-        for (quint32 i = 0; i < instanceCount; ++i) {
-            // ignoring LOD objects for now
-            if (!objects[idxToObj[i]].lod) {
-                const auto matrix = matrices[i].values;
-                gNodes.append(QVariantMap{
-                    {u"name"_qs, instanceNames[i]},
-                    {u"mesh"_qs, objects[idxToObj[i]].meshIndex},
-                    // glTF wants column-major row order, we have row-major, we also swap
-                    // the Y and Z rows to get Z+ up instead of Y- up for blender
-                    // clang-format off
-                {u"matrix"_qs, QVariantList{
-                     matrix[ 0], matrix[ 8], matrix[ 4], 0.0f,
-                     matrix[ 1], matrix[ 9], matrix[ 5], 0.0f,
-                     matrix[ 2], matrix[10], matrix[ 6], 0.0f,
-                     matrix[ 3], matrix[11], matrix[ 7], 1.0f,
-                }},
-                    // clang-format on
-                });
-            }
-        }
-
-        QFile fBuff(u"D:\\Projects\\disrev\\level.bwm"_qs);
-        if (fBuff.open(QFile::WriteOnly)) {
-            fBuff.write(input);
-            fBuff.close();
-            gBuffers.append(QVariantMap{
-                {u"byteLength"_qs, input.size()},
-                {u"uri"_qs, u"level.bwm"_qs},
-            });
-        } else {
-            qWarning() << "Failed to open:" << fBuff.fileName();
-        }
-
-        QVariantMap gltf{
-            {u"asset"_qs, QVariantMap{{u"version"_qs, u"2.0"_qs}}},
-            {u"buffers"_qs, gBuffers},
-            {u"bufferViews"_qs, gBufferViews},
-            {u"accessors"_qs, gAccessors},
-            {u"meshes"_qs, gMeshes},
-            {u"nodes"_qs, gNodes},
-        };
-        QFile fGltf(u"D:\\Projects\\disrev\\level.gltf"_qs);
-        if (fGltf.open(QFile::WriteOnly)) {
-            fGltf.write(QJsonDocument::fromVariant(gltf).toJson());
-            fGltf.close();
-        } else {
-            qWarning() << "Failed to open:" << fGltf.fileName();
-        }
-    }
-
     return {};
 }
 
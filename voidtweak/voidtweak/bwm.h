@@ -88,6 +88,8 @@
  * }
  */
 
+#include <QBitArray>
+#include <QByteArrayView>
 #include <QList>
 #include <QObject>
 #include <QString>
@@ -141,6 +143,12 @@ struct PODInstance {
 QDebug operator<<(QDebug d, const PODInstance &m);
 QString vert(float v[3]);
 
+// axis aligned box, min > max on any axis means there is nothing to bound
+struct Bounds {
+    float min[3];
+    float max[3];
+};
+
 struct PODObject {
     qint64 offset;
     quint32 indexStart; // matrix/instance start
@@ -155,143 +163,145 @@ struct PODObject {
 QDebug operator<<(QDebug d, const PODObject &o);
 QString matName(const PODObject &obj);
 
-class Matrix : public QObject
-{
-    Q_OBJECT
-    QML_ELEMENT
-    QML_UNCREATABLE("Backend only.")
-
-    Q_PROPERTY(qint64 offset READ offset CONSTANT)
-    Q_PROPERTY(float x1 READ x1 WRITE setX1 NOTIFY dataChanged)
-    Q_PROPERTY(float x2 READ x2 WRITE setX2 NOTIFY dataChanged)
-    Q_PROPERTY(float x3 READ x3 WRITE setX3 NOTIFY dataChanged)
-    Q_PROPERTY(float x4 READ x4 WRITE setX4 NOTIFY dataChanged)
-    Q_PROPERTY(float y1 READ y1 WRITE setY1 NOTIFY dataChanged)
-    Q_PROPERTY(float y2 READ y2 WRITE setY2 NOTIFY dataChanged)
-    Q_PROPERTY(float y3 READ y3 WRITE setY3 NOTIFY dataChanged)
-    Q_PROPERTY(float y4 READ y4 WRITE setY4 NOTIFY dataChanged)
-    Q_PROPERTY(float z1 READ z1 WRITE setZ1 NOTIFY dataChanged)
-    Q_PROPERTY(float z2 READ z2 WRITE setZ2 NOTIFY dataChanged)
-    Q_PROPERTY(float z3 READ z3 WRITE setZ3 NOTIFY dataChanged)
-    Q_PROPERTY(float z4 READ z4 WRITE setZ4 NOTIFY dataChanged)
+// everything in a level file, the vertex sections are left as views into the
+// buffer that was parsed and are only valid for as long as it is
+struct Level {
+    QByteArrayView vertexCoords;
+    QByteArrayView vertexData;
+    QByteArrayView vertexIndices;
+    QList<PODMatrix> matrices;
+    QList<PODMesh> meshes;
+    QList<PODObject> objects; // matrices and instances are not filled in here
+    QList<PODInstance> instances;
+    Group darkVision[3];           // idx1-3, darkVisionLayer 1-3
+    QList<LabeledGroup> lodGroups; // g1, distant objects overriding LOD/culling
+    QList<Group> groups;           // g2
+    Group physics;                 // idx5
+};
 
+// the group tables of a level flattened into one member array, every group also
+// gets a bitset over the instance range it spans so membership is a single test
+class Groups
+{
   public:
-    explicit Matrix(const PODMatrix &data, QObject *parent);
-    PODMatrix pod() const { return m_data; }
-    const qint64 &offset() const { return m_data.offset; }
-    const float &x1() const { return m_data.values[0]; }
-    const float &x2() const { return m_data.values[1]; }
-    const float &x3() const { return m_data.values[2]; }
-    const float &x4() const { return m_data.values[3]; }
-    const float &y1() const { return m_data.values[4]; }
-    const float &y2() const { return m_data.values[5]; }
-    const float &y3() const { return m_data.values[6]; }
-    const float &y4() const { return m_data.values[7]; }
-    const float &z1() const { return m_data.values[8]; }
-    const float &z2() const { return m_data.values[9]; }
-    const float &z3() const { return m_data.values[10]; }
-    const float &z4() const { return m_data.values[11]; }
-    void setX1(const float &v);
-    void setX2(const float &v);
-    void setX3(const float &v);
-    void setX4(const float &v);
-    void setY1(const float &v);
-    void setY2(const float &v);
-    void setY3(const float &v);
-    void setY4(const float &v);
-    void setZ1(const float &v);
-    void setZ2(const float &v);
-    void setZ3(const float &v);
-    void setZ4(const float &v);
+    enum Kind {
+        DarkVision, // label is the layer, 1-3
+        Lod,        // label is the g1 label
+        Plain,
+        Physics,
+    };
 
-  signals:
-    void dataChanged();
+    Groups() = default;
+    explicit Groups(const Level &level);
+    qsizetype count() const { return m_kinds.count(); }
+    Kind kind(qsizetype group) const { return m_kinds.at(group); }
+    quint32 label(qsizetype group) const { return m_labels.at(group); }
+    QList<quint32> instances(qsizetype group) const;
+    qsizetype size(qsizetype group) const { return m_starts.at(group + 1) - m_starts.at(group); }
+    bool contains(qsizetype group, quint32 instance) const;
+    QList<qsizetype> groupsOf(quint32 instance) const;
+    // first dark vision layer listing the instance, 0 if it is in none
+    int darkVisionLayer(quint32 instance) const;
 
   private:
-    PODMatrix m_data;
+    // members not below instanceCount are left out
+    void append(Kind kind, quint32 label, const Group &members, qsizetype instanceCount);
+
+    QList<Kind> m_kinds;
+    QList<quint32> m_labels;
+    QList<qsizetype> m_starts; // where each group begins in m_members, plus the end
+    QList<quint32> m_members;
+    QList<quint32> m_firsts; // lowest member of each group, bit 0 of its bitset
+    QList<QBitArray> m_bits;
+    QList<qsizetype> m_instanceStarts; // where each instance begins in m_instanceGroups
+    QList<qsizetype> m_instanceGroups;
+    QList<quint8> m_layers;
 };
 
-class Instance : public QObject
+// objects of a level with their matrices and instances packed by instance index,
+// the UI models read from here so batch edits touch one flat array
+class Store : public QObject
 {
     Q_OBJECT
-    QML_ELEMENT
-    QML_UNCREATABLE("Backend only.")
-
-    Q_PROPERTY(qint64 offset READ offset CONSTANT)
-    Q_PROPERTY(float minX READ minX WRITE setMinX NOTIFY dataChanged)
-    Q_PROPERTY(float minY READ minY WRITE setMinY NOTIFY dataChanged)
-    Q_PROPERTY(float minZ READ minZ WRITE setMinZ NOTIFY dataChanged)
-    Q_PROPERTY(float maxX READ maxX WRITE setMaxX NOTIFY dataChanged)
-    Q_PROPERTY(float maxY READ maxY WRITE setMaxY NOTIFY dataChanged)
-    Q_PROPERTY(float maxZ READ maxZ WRITE setMaxZ NOTIFY dataChanged)
-    Q_PROPERTY(quint32 unk1 READ unk1 CONSTANT)
-    Q_PROPERTY(qint16 unk2 READ unk2 CONSTANT)
 
   public:
-    explicit Instance(const PODInstance &data, QObject *parent);
-    PODInstance pod() const { return m_data; }
-    const qint64 &offset() const { return m_data.offset; }
-    const float &minX() const { return m_data.min[0]; }
-    const float &minY() const { return m_data.min[1]; }
-    const float &minZ() const { return m_data.min[2]; }
-    const float &maxX() const { return m_data.max[0]; }
-    const float &maxY() const { return m_data.max[1]; }
-    const float &maxZ() const { return m_data.max[2]; }
-    const quint32 &unk1() const { return m_data.unk1; }
-    const qint16 &unk2() const { return m_data.unk2; }
-    void setMinX(const float &v);
-    void setMinY(const float &v);
-    void setMinZ(const float &v);
-    void setMaxX(const float &v);
-    void setMaxY(const float &v);
-    void setMaxZ(const float &v);
+    // meshBounds are the local bounds of each mesh in the level, instances whose
+    // matrix changes get their world bounds recomputed from them
+    explicit Store(const QList<PODObject> &objects, const QList<Bounds> &meshBounds,
+                   const Groups &groups, QObject *parent);
+    qsizetype count() const { return m_matrices.count(); }
+    const PODMatrix &matrix(quint32 index) const { return m_matrices.at(index); }
+    const PODInstance &instance(quint32 index) const { return m_instances.at(index); }
+    // changed at some point since the level was loaded, saves only write these
+    bool matrixDirty(quint32 index) const { return m_dirtyMatrices.testBit(index); }
+    bool instanceDirty(quint32 index) const { return m_dirtyInstances.testBit(index); }
+    // single value edits are not undo steps, they drop the transform history instead
+    void setMatrixValue(quint32 index, int k, float v);
+    void setInstanceValue(quint32 index, int k, float v);
 
-  signals:
-    void dataChanged();
+    // objects keep their header fields only, placements live in the arrays above
+    qsizetype objectCount() const { return m_objects.count(); }
+    const PODObject &object(qsizetype index) const { return m_objects.at(index); }
+    // object placing an instance, -1 for slots no object owns
+    qint32 owner(quint32 index) const { return m_owners.at(index); }
+    // dirtyOnly leaves out placements that haven't changed since loading
+    PODObject pod(qsizetype object, bool dirtyOnly = false) const;
+    // edits never move instances between groups, these stay as loaded
+    const Groups &groups() const { return m_groups; }
 
-  private:
-    PODInstance m_data;
-};
+    // m = op * m for every index, one undo step and one changed() per call
+    void transform(const QList<quint32> &indexes, const float op[12]);
+    bool canUndo() const { return !m_undo.isEmpty(); }
+    bool canRedo() const { return !m_redo.isEmpty(); }
+    void undo();
+    void redo();
 
-class Object : public QObject
-{
-    Q_OBJECT
-    QML_ELEMENT
-    QML_UNCREATABLE("Backend only.")
+  signals:
+    void changed();
 
-    Q_PROPERTY(qint64 offset READ offset CONSTANT)
-    Q_PROPERTY(quint32 indexStart READ indexStart CONSTANT)
-    Q_PROPERTY(quint32 indexEnd READ indexEnd CONSTANT)
-    Q_PROPERTY(quint32 meshIndex READ meshIndex CONSTANT)
-    Q_PROPERTY(quint8 isFlipped READ isFlipped CONSTANT)
-    Q_PROPERTY(QString materialPath READ materialPath CONSTANT)
-    Q_PROPERTY(quint32 lod READ lod CONSTANT)
-    Q_PROPERTY(QList<Matrix *> matrices READ matrices CONSTANT)
-    Q_PROPERTY(const QList<Instance *> instances READ instances CONSTANT)
+  private:
+    struct Batch {
+        QList<quint32> indexes;
+        float op[12];
+        QList<float> before; // 12 floats per index
+        QList<PODInstance> instances;
+    };
 
-  public:
-    explicit Object(const PODObject &data, QObject *parent);
-    PODObject pod();
-    const qint64 &offset() const { return m_data.offset; }
-    const quint32 &indexStart() const { return m_data.indexStart; }
-    const quint32 &indexEnd() const { return m_data.indexEnd; }
-    const quint32 &meshIndex() const { return m_data.meshIndex; }
-    const quint8 &isFlipped() const { return m_data.isFlipped; }
-    const QString &materialPath() const { return m_data.materialPath; }
-    const quint32 &lod() const { return m_data.lod; }
-    const QList<Matrix *> &matrices() const { return m_matrices; }
-    const QList<Instance *> &instances() const { return m_instances; }
+    QList<float> gather(const QList<quint32> &indexes) const;
+    void scatter(const QList<quint32> &indexes, const QList<float> &values);
+    void updateBounds(const QList<quint32> &indexes);
+    void markDirty(const QList<quint32> &indexes);
+    void dropHistory();
 
-  private:
-    PODObject m_data;
-    QList<Matrix *> m_matrices;
-    QList<Instance *> m_instances;
+    QList<PODObject> m_objects;
+    QList<qint32> m_owners;
+    QList<PODMatrix> m_matrices;
+    QList<PODInstance> m_instances;
+    QList<Bounds> m_local; // mesh bounds of each instance
+    QBitArray m_dirtyMatrices;
+    QBitArray m_dirtyInstances;
+    QList<Batch> m_undo;
+    QList<Batch> m_redo;
+    Groups m_groups;
 };
 
 void setScale(const float &scale, PODMatrix *matrix);
 
-QString parse(const QByteArray &input, QList<PODObject> &objects);
+// validates every section size up front then reads the arrays in bulk
+QString parseLevel(QByteArrayView input, Level &level);
+
+// local space bounds of every mesh, decoded from the vertex coords, meshes whose
+// vertices can't be read get an empty box
+QList<Bounds> meshBounds(const Level &level);
+
+QString parse(const QByteArray &input, QList<PODObject> &objects,
+              QList<Bounds> *meshBounds = nullptr, Groups *groups = nullptr);
+
+// the original QDataStream parser, kept to check and benchmark parseLevel against
+QString parseReference(const QByteArray &input, QList<PODObject> &objects);
 
+// only matrices and instances are written back at their offsets, the group tables
+// and everything else stay exactly as they are in output
 QString inject(const PODObject &obj, QByteArray *output);
 
 QString inject(const QList<PODObject> &objects, QByteArray *output);
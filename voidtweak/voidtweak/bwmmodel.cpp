@@ -0,0 +1,261 @@
+#include "bwmmodel.h"
+
+namespace bwm
+{
+
+ObjectModel::ObjectModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_store(nullptr)
+    , m_filter()
+    , m_rows()
+{
+}
+
+void ObjectModel::setStore(Store *store)
+{
+    m_store = store;
+    update();
+}
+
+int ObjectModel::total() const
+{
+    return m_store ? static_cast<int>(m_store->objectCount()) : 0;
+}
+
+void ObjectModel::setFilter(const QString &filter)
+{
+    if (filter != m_filter) {
+        m_filter = filter;
+        update();
+        emit filterChanged();
+    }
+}
+
+void ObjectModel::update()
+{
+    beginResetModel();
+    m_rows.clear();
+    for (qsizetype i = 0; m_store && i < m_store->objectCount(); ++i) {
+        if (m_filter.isEmpty() || m_store->object(i).materialPath.contains(m_filter)) {
+            m_rows.append(static_cast<qint32>(i));
+        }
+    }
+    endResetModel();
+    emit countChanged();
+}
+
+QVariantMap ObjectModel::get(int row) const
+{
+    QVariantMap map;
+    if (row < 0 || row >= m_rows.count()) {
+        return map;
+    }
+    const QModelIndex i = index(row);
+    const auto names = roleNames();
+    for (auto it = names.cbegin(); it != names.cend(); ++it) {
+        map.insert(QString::fromLatin1(it.value()), data(i, it.key()));
+    }
+    return map;
+}
+
+int ObjectModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : count();
+}
+
+QVariant ObjectModel::data(const QModelIndex &index, int role) const
+{
+    if (!m_store || !index.isValid() || index.row() >= m_rows.count()) {
+        return {};
+    }
+    const qint32 i = m_rows[index.row()];
+    const PODObject &o = m_store->object(i);
+    switch (role) {
+    case ObjectIndexRole:
+        return i;
+    case OffsetRole:
+        return o.offset;
+    case IndexStartRole:
+        return o.indexStart;
+    case IndexEndRole:
+        return o.indexEnd;
+    case MeshIndexRole:
+        return o.meshIndex;
+    case IsFlippedRole:
+        return o.isFlipped;
+    case MaterialPathRole:
+        return o.materialPath;
+    case LodRole:
+        return o.lod;
+    case InstanceCountRole:
+        return o.indexEnd - o.indexStart;
+    }
+    return {};
+}
+
+QHash<int, QByteArray> ObjectModel::roleNames() const
+{
+    return {
+        {ObjectIndexRole, "objectIndex"},
+        {OffsetRole, "offset"},
+        {IndexStartRole, "indexStart"},
+        {IndexEndRole, "indexEnd"},
+        {MeshIndexRole, "meshIndex"},
+        {IsFlippedRole, "isFlipped"},
+        {MaterialPathRole, "materialPath"},
+        {LodRole, "lod"},
+        {InstanceCountRole, "instanceCount"},
+    };
+}
+
+InstanceModel::InstanceModel(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_store(nullptr)
+    , m_object(-1)
+    , m_first(0)
+    , m_count(0)
+{
+}
+
+void InstanceModel::setStore(Store *store)
+{
+    if (m_store) {
+        disconnect(m_store, nullptr, this, nullptr);
+    }
+    beginResetModel();
+    m_store = store;
+    m_object = -1;
+    m_first = 0;
+    m_count = 0;
+    endResetModel();
+    if (m_store) {
+        connect(m_store, &Store::changed, this, &InstanceModel::storeChanged);
+    }
+    emit objectChanged();
+}
+
+void InstanceModel::setObject(int object)
+{
+    if (!m_store || object < 0 || object >= m_store->objectCount()) {
+        object = -1;
+    }
+    if (object == m_object) {
+        return;
+    }
+    beginResetModel();
+    m_object = object;
+    m_first = 0;
+    m_count = 0;
+    if (m_object >= 0) {
+        const PODObject &o = m_store->object(m_object);
+        m_first = o.indexStart;
+        m_count = static_cast<int>(qMin<qsizetype>(o.indexEnd, m_store->count()) - o.indexStart);
+    }
+    endResetModel();
+    emit objectChanged();
+}
+
+void InstanceModel::storeChanged()
+{
+    // transforms can cover thousands of instances, only the visible ones re-read
+    if (m_count) {
+        emit dataChanged(index(0), index(m_count - 1));
+    }
+}
+
+int InstanceModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_count;
+}
+
+QVariant InstanceModel::data(const QModelIndex &index, int role) const
+{
+    if (!m_store || !index.isValid() || index.row() >= m_count) {
+        return {};
+    }
+    const quint32 i = m_first + static_cast<quint32>(index.row());
+    if (role >= X1Role && role < X1Role + 12) {
+        return m_store->matrix(i).values[role - X1Role];
+    }
+    const PODInstance &ins = m_store->instance(i);
+    if (role >= MinXRole && role <= MinZRole) {
+        return ins.min[role - MinXRole];
+    }
+    if (role >= MaxXRole && role <= MaxZRole) {
+        return ins.max[role - MaxXRole];
+    }
+    switch (role) {
+    case InstanceIndexRole:
+        return i;
+    case MatrixOffsetRole:
+        return m_store->matrix(i).offset;
+    case InstanceOffsetRole:
+        return ins.offset;
+    case DirtyRole:
+        return m_store->matrixDirty(i) || m_store->instanceDirty(i);
+    case DarkVisionLayerRole:
+        return m_store->groups().darkVisionLayer(i);
+    case GroupCountRole:
+        return m_store->groups().groupsOf(i).count();
+    case Unk1Role:
+        return ins.unk1;
+    case Unk2Role:
+        return ins.unk2;
+    }
+    return {};
+}
+
+bool InstanceModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!m_store || !index.isValid() || index.row() >= m_count) {
+        return false;
+    }
+    bool ok;
+    const float v = value.toFloat(&ok);
+    if (!ok) {
+        return false;
+    }
+    // the store emits changed, which comes back here as dataChanged
+    const quint32 i = m_first + static_cast<quint32>(index.row());
+    if (role >= X1Role && role < X1Role + 12) {
+        m_store->setMatrixValue(i, role - X1Role, v);
+        return true;
+    }
+    if (role >= MinXRole && role <= MaxZRole) {
+        m_store->setInstanceValue(i, role - MinXRole, v);
+        return true;
+    }
+    return false;
+}
+
+Qt::ItemFlags InstanceModel::flags(const QModelIndex &index) const
+{
+    return QAbstractListModel::flags(index) | Qt::ItemIsEditable;
+}
+
+QHash<int, QByteArray> InstanceModel::roleNames() const
+{
+    QHash<int, QByteArray> names{
+        {InstanceIndexRole, "instanceIndex"},
+        {MatrixOffsetRole, "matrixOffset"},
+        {InstanceOffsetRole, "instanceOffset"},
+        {DirtyRole, "dirty"},
+        {DarkVisionLayerRole, "darkVisionLayer"},
+        {GroupCountRole, "groupCount"},
+        {Unk1Role, "unk1"},
+        {Unk2Role, "unk2"},
+        {MinXRole, "minX"},
+        {MinYRole, "minY"},
+        {MinZRole, "minZ"},
+        {MaxXRole, "maxX"},
+        {MaxYRole, "maxY"},
+        {MaxZRole, "maxZ"},
+    };
+    const char rows[3] = {'x', 'y', 'z'};
+    for (int k = 0; k < 12; ++k) {
+        names.insert(X1Role + k, QByteArray(1, rows[k / 4]) + QByteArray::number(k % 4 + 1));
+    }
+    return names;
+}
+
+} // namespace bwm
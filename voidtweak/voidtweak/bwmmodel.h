@@ -0,0 +1,114 @@
+#ifndef BWMMODEL_H
+#define BWMMODEL_H
+
+#include <QAbstractListModel>
+#include <QtQml>
+
+#include "bwm.h"
+
+namespace bwm
+{
+
+// objects of the loaded level, optionally filtered on material path
+class ObjectModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Backend only.")
+
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int total READ total NOTIFY countChanged)
+    Q_PROPERTY(QString filter READ filter WRITE setFilter NOTIFY filterChanged)
+
+  public:
+    enum Roles {
+        ObjectIndexRole = Qt::UserRole + 1,
+        OffsetRole,
+        IndexStartRole,
+        IndexEndRole,
+        MeshIndexRole,
+        IsFlippedRole,
+        MaterialPathRole,
+        LodRole,
+        InstanceCountRole,
+    };
+
+    explicit ObjectModel(QObject *parent);
+    void setStore(Store *store);
+    int count() const { return static_cast<int>(m_rows.count()); }
+    int total() const;
+    const QString &filter() const { return m_filter; }
+    void setFilter(const QString &filter);
+    // every role of a row as a plain map, for holding on to after the delegate is gone
+    Q_INVOKABLE QVariantMap get(int row) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+  signals:
+    void countChanged();
+    void filterChanged();
+
+  private:
+    void update();
+
+    Store *m_store;
+    QString m_filter;
+    QList<qint32> m_rows; // object indexes that pass the filter
+};
+
+// placements of a single object, editing a row writes straight into the store
+class InstanceModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("Backend only.")
+
+    Q_PROPERTY(int object READ object WRITE setObject NOTIFY objectChanged)
+
+  public:
+    enum Roles {
+        InstanceIndexRole = Qt::UserRole + 1,
+        MatrixOffsetRole,
+        InstanceOffsetRole,
+        DirtyRole,
+        DarkVisionLayerRole,
+        GroupCountRole,
+        Unk1Role,
+        Unk2Role,
+        X1Role, // 12 matrix values in row-major order
+        MinXRole = X1Role + 12,
+        MinYRole,
+        MinZRole,
+        MaxXRole,
+        MaxYRole,
+        MaxZRole,
+    };
+
+    explicit InstanceModel(QObject *parent);
+    void setStore(Store *store);
+    int object() const { return m_object; }
+    void setObject(int object);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+  signals:
+    void objectChanged();
+
+  private:
+    void storeChanged();
+
+    Store *m_store;
+    int m_object;
+    quint32 m_first;
+    int m_count;
+};
+
+} // namespace bwm
+
+#endif // BWMMODEL_H
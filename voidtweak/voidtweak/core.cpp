@@ -1,14 +1,22 @@
 #include "core.h"
 
+#include <QElapsedTimer>
 #include <QProcess>
+#include <QSettings>
+#include <QtMath>
 #include <algorithm>
 
+#include "affine.h"
 #include "steam.h"
 
 Core::Core(QObject *parent)
     : QObject{parent}
     , m_error()
     , m_busy(false)
+    , m_report()
+    , m_useOverlay(QSettings().value(u"useOverlay"_qs, false).toBool())
+    , m_overlayCount(0)
+    , m_indexedLevels(0)
     , m_containerCount(0)
     , m_entryCount(0)
     , m_sortOrder(SortNone)
@@ -17,8 +25,12 @@ Core::Core(QObject *parent)
     , m_rm(new ResourceManager)
     , m_rmThread(new QThread(this))
     , m_searchResultDebounce(new QTimer(this))
+    , m_bvhDebounce(new QTimer(this))
     , m_entry(nullptr)
     , m_entities()
+    , m_store(nullptr)
+    , m_objectModel(new bwm::ObjectModel(this))
+    , m_instanceModel(new bwm::InstanceModel(this))
     , m_script(nullptr)
 {
     m_rm->moveToThread(m_rmThread);
@@ -29,22 +41,46 @@ Core::Core(QObject *parent)
     connect(this, &Core::insertEntry, m_rm, &ResourceManager::insertEntry);
     connect(this, &Core::exportEntry, m_rm, &ResourceManager::exportEntry);
     connect(this, &Core::importEntry, m_rm, &ResourceManager::importEntry);
+    connect(this, &Core::importFromArchive, m_rm, &ResourceManager::importFromArchive);
     connect(this, &Core::loadEntities, m_rm, &ResourceManager::loadEntities);
     connect(this, &Core::exportAllEntries, m_rm, &ResourceManager::exportAllEntries);
+    connect(this, &Core::exportUniqueEntries, m_rm, &ResourceManager::exportUniqueEntries);
+    connect(this, &Core::exportArchive, m_rm, &ResourceManager::exportArchive);
+    connect(this, &Core::findDuplicates, m_rm, &ResourceManager::findDuplicates);
+    connect(this, &Core::startVerifying, m_rm, &ResourceManager::verifyAll);
+    connect(this, &Core::compactResources, m_rm, &ResourceManager::compactResources);
+    connect(this, &Core::useOverlayChanged, m_rm, &ResourceManager::setUseOverlay);
+    connect(this, &Core::deployOverlay, m_rm, &ResourceManager::deployOverlay);
+    connect(this, &Core::discardOverlay, m_rm, &ResourceManager::discardOverlay);
+    connect(this, &Core::exportPatches, m_rm, &ResourceManager::exportPatches);
+    connect(this, &Core::importPatches, m_rm, &ResourceManager::importPatches);
+    connect(this, &Core::benchmarkBwm, m_rm, &ResourceManager::benchmarkBwm);
+    connect(this, &Core::indexLevels, m_rm, &ResourceManager::indexLevels);
     connect(this, &Core::loadBwm, m_rm, &ResourceManager::loadBwm);
+    connect(this, &Core::exportMesh, m_rm, &ResourceManager::exportMesh);
     connect(this, &Core::startSavingObject, m_rm, &ResourceManager::saveObject);
     connect(this, &Core::startSavingObjects, m_rm, &ResourceManager::saveObjects);
     connect(m_rm, &ResourceManager::statusChanged, this, &Core::rmStatusChanged);
+    connect(m_rm, &ResourceManager::report, this, &Core::rmReport);
+    connect(m_rm, &ResourceManager::overlayChanged, this, &Core::setOverlayCount);
     connect(m_rm, &ResourceManager::indexesLoaded, this, &Core::indexesLoaded);
     connect(m_rm, &ResourceManager::searchResult, this, &Core::searchResult);
     connect(m_rm, &ResourceManager::extractResult, this, &Core::extractResult);
     connect(m_rm, &ResourceManager::entitiesLoaded, this, &Core::entitiesLoaded);
     connect(m_rm, &ResourceManager::bwmLoaded, this, &Core::bwmLoaded);
+    connect(m_rm, &ResourceManager::levelIndexChanged, this, &Core::levelIndexChanged);
     m_rmThread->start();
+    connect(this, &Core::useOverlayChanged, this,
+            [](bool useOverlay) { QSettings().setValue(u"useOverlay"_qs, useOverlay); });
+    emit useOverlayChanged(m_useOverlay);
 
     m_searchResultDebounce->setInterval(100);
     m_searchResultDebounce->setSingleShot(true);
     connect(m_searchResultDebounce, &QTimer::timeout, this, &Core::resultsChanged);
+    // typing into a matrix field changes the store on every value, rebuild once it settles
+    m_bvhDebounce->setInterval(250);
+    m_bvhDebounce->setSingleShot(true);
+    connect(m_bvhDebounce, &QTimer::timeout, this, &Core::buildBvh);
 
     QTimer::singleShot(100, this, &Core::loadIndexes);
 }
@@ -178,6 +214,15 @@ void Core::search(const QString &query)
     }
 }
 
+void Core::verifyAll()
+{
+    if (!m_busy) {
+        // anything that fails verification shows up as a result
+        clear();
+        emit startVerifying();
+    }
+}
+
 void Core::clear()
 {
     if (!m_busy) {
@@ -205,6 +250,12 @@ void Core::rmStatusChanged(bool busy, QString error)
     setError(error);
 }
 
+void Core::rmReport(QString message)
+{
+    qInfo() << message;
+    setReport(message);
+}
+
 void Core::indexesLoaded(int containerCount, int entryCount)
 {
     setContainerCount(containerCount);
@@ -223,14 +274,14 @@ void Core::searchResult(const QPointer<Entry> entry)
 
 void Core::extractResult(const QPointer<Entry>, QByteArray) {}
 
-void Core::entitiesLoaded(const QPointer<Entry> ref, QList<decl::Scope> entities)
+void Core::entitiesLoaded(const QPointer<Entry> ref, decl::Tree tree)
 {
     if (m_results.contains(ref)) {
         qDebug() << "Building full entities...";
         qDeleteAllLater(m_entities);
         m_entry = m_results.at(m_results.indexOf(ref));
-        for (const auto &scope : entities) {
-            m_entities.append(new decl::Entity(scope, this));
+        for (qsizetype i = 0; i < tree.entities().count(); ++i) {
+            m_entities.append(new decl::Entity(tree, i, this));
         }
         qInfo() << "Built" << m_entities.count() << "for" << ref;
         emit entitiesChanged();
@@ -239,22 +290,243 @@ void Core::entitiesLoaded(const QPointer<Entry> ref, QList<decl::Scope> entities
     }
 }
 
-void Core::bwmLoaded(const QPointer<Entry> ref, QList<bwm::PODObject> objects)
+void Core::bwmLoaded(const QPointer<Entry> ref, QList<bwm::PODObject> objects,
+                     QList<bwm::Bounds> meshBounds, bwm::Groups groups)
 {
     if (m_results.contains(ref)) {
-        qDebug() << "Building full objects...";
-        qDeleteAllLater(m_objects);
+        qDebug() << "Building level store...";
         m_entry = m_results.at(m_results.indexOf(ref));
-        for (const auto &o : objects) {
-            m_objects.append(new bwm::Object(o, this));
+        bwm::Store *old = m_store;
+        m_store = new bwm::Store(objects, meshBounds, groups, this);
+        // edits move instance bounds, so the tree follows the store
+        connect(m_store, &bwm::Store::changed, m_bvhDebounce, qOverload<>(&QTimer::start));
+        m_instanceModel->setStore(m_store);
+        m_objectModel->setStore(m_store);
+        if (old) {
+            old->deleteLater();
         }
-        qInfo() << "Built" << m_objects.count() << "objects for" << ref;
-        emit objectsChanged();
+        QElapsedTimer timer;
+        timer.start();
+        buildBvh();
+        qInfo() << "Built" << m_store->objectCount() << "objects for" << ref << "and a bvh over"
+                << m_store->count() << "instances in" << timer.elapsed() << "ms";
     } else {
         qWarning() << "No matching entry in results:" << ref;
     }
 }
 
+void Core::buildBvh()
+{
+    m_bvhDebounce->stop();
+    if (!m_store) {
+        return;
+    }
+    // instances not owned by any object get an inverted box and stay out of the tree
+    QList<Bvh::Box> boxes(m_store->count(), {{1, 1, 1}, {0, 0, 0}});
+    for (qsizetype i = 0; i < boxes.count(); ++i) {
+        const quint32 index = static_cast<quint32>(i);
+        if (m_store->owner(index) >= 0) {
+            const bwm::PODInstance &ins = m_store->instance(index);
+            std::copy(ins.min, ins.min + 3, boxes[i].min);
+            std::copy(ins.max, ins.max + 3, boxes[i].max);
+        }
+    }
+    m_bvh.build(boxes);
+}
+
+void Core::levelIndexChanged(LevelIndex index)
+{
+    m_levelIndex = index;
+    setIndexedLevels(static_cast<int>(m_levelIndex.levels().count()));
+}
+
+QStringList Core::findMaterials(const QString &query) const
+{
+    QStringList materials;
+    for (const auto &material : m_levelIndex.materials()) {
+        if (material.contains(query, Qt::CaseInsensitive)) {
+            materials.append(material);
+        }
+    }
+    materials.sort();
+    return materials;
+}
+
+QVariantList Core::materialUses(const QString &material) const
+{
+    QVariantList uses;
+    for (const auto &use : m_levelIndex.uses(material)) {
+        uses.append(QVariantMap{
+            {u"level"_qs, use.level},
+            {u"object"_qs, use.object},
+            {u"mesh"_qs, use.mesh},
+            {u"instances"_qs, use.instances},
+        });
+    }
+    return uses;
+}
+
+static QList<int> toIndexes(const QList<quint32> &items)
+{
+    return QList<int>(items.cbegin(), items.cend());
+}
+
+const Bvh &Core::bvh()
+{
+    // queries right after an edit must not see the old bounds
+    if (m_bvhDebounce->isActive()) {
+        buildBvh();
+    }
+    return m_bvh;
+}
+
+QList<int> Core::instancesInBox(const QVector3D &min, const QVector3D &max)
+{
+    return toIndexes(bvh().inBox({{min.x(), min.y(), min.z()}, {max.x(), max.y(), max.z()}}));
+}
+
+QList<int> Core::instancesInSphere(const QVector3D &center, float radius)
+{
+    const float c[3] = {center.x(), center.y(), center.z()};
+    return toIndexes(bvh().inSphere(c, radius));
+}
+
+QList<int> Core::instancesOnRay(const QVector3D &origin, const QVector3D &direction)
+{
+    const float o[3] = {origin.x(), origin.y(), origin.z()};
+    const float d[3] = {direction.x(), direction.y(), direction.z()};
+    return toIndexes(bvh().onRay(o, d));
+}
+
+QList<int> Core::nearestInstances(const QVector3D &point, int k)
+{
+    const float p[3] = {point.x(), point.y(), point.z()};
+    return toIndexes(bvh().nearest(p, k));
+}
+
+int Core::instanceObject(int index) const
+{
+    if (!m_store || index < 0 || index >= m_store->count()) {
+        return -1;
+    }
+    return m_store->owner(static_cast<quint32>(index));
+}
+
+QVariantList Core::instanceGroups(int index) const
+{
+    QVariantList groups;
+    if (!m_store || index < 0 || index >= m_store->count()) {
+        return groups;
+    }
+    static const QString kinds[] = {u"darkVision"_qs, u"lod"_qs, u"group"_qs, u"physics"_qs};
+    const bwm::Groups &g = m_store->groups();
+    for (const qsizetype group : g.groupsOf(static_cast<quint32>(index))) {
+        groups.append(QVariantMap{
+            {u"group"_qs, group},
+            {u"kind"_qs, kinds[g.kind(group)]},
+            {u"label"_qs, g.label(group)},
+            {u"size"_qs, g.size(group)},
+        });
+    }
+    return groups;
+}
+
+QList<int> Core::groupInstances(int group) const
+{
+    if (!m_store || group < 0 || group >= m_store->groups().count()) {
+        return {};
+    }
+    return toIndexes(m_store->groups().instances(group));
+}
+
+int Core::darkVisionLayer(int index) const
+{
+    if (!m_store || index < 0) {
+        return 0;
+    }
+    return m_store->groups().darkVisionLayer(static_cast<quint32>(index));
+}
+
+static QList<quint32> toItems(const QList<int> &indexes)
+{
+    QList<quint32> items;
+    items.reserve(indexes.count());
+    for (const auto i : indexes) {
+        if (i >= 0) {
+            items.append(static_cast<quint32>(i));
+        }
+    }
+    return items;
+}
+
+// middle of the selection's translations, which is where rotation and scale pivot
+static void pivot(const bwm::Store *store, const QList<quint32> &items, float out[3])
+{
+    out[0] = out[1] = out[2] = 0.0f;
+    qsizetype count = 0;
+    for (const auto i : items) {
+        if (static_cast<qsizetype>(i) < store->count()) {
+            const float *m = store->matrix(i).values;
+            out[0] += m[3];
+            out[1] += m[7];
+            out[2] += m[11];
+            ++count;
+        }
+    }
+    for (int k = 0; count && k < 3; ++k) {
+        out[k] /= static_cast<float>(count);
+    }
+}
+
+void Core::translateInstances(const QList<int> &indexes, const QVector3D &offset)
+{
+    if (m_store) {
+        const float t[3] = {offset.x(), offset.y(), offset.z()};
+        float op[12];
+        affine::translation(t, op);
+        m_store->transform(toItems(indexes), op);
+    }
+}
+
+void Core::rotateInstances(const QList<int> &indexes, const QVector3D &axis, float degrees)
+{
+    if (m_store) {
+        const QList<quint32> items = toItems(indexes);
+        const float a[3] = {axis.x(), axis.y(), axis.z()};
+        float p[3];
+        pivot(m_store, items, p);
+        float op[12];
+        affine::rotation(a, qDegreesToRadians(degrees), p, op);
+        m_store->transform(items, op);
+    }
+}
+
+void Core::scaleInstances(const QList<int> &indexes, float factor)
+{
+    if (m_store) {
+        const QList<quint32> items = toItems(indexes);
+        float p[3];
+        pivot(m_store, items, p);
+        float op[12];
+        affine::scaling(factor, p, op);
+        m_store->transform(items, op);
+    }
+}
+
+void Core::undoTransform()
+{
+    if (m_store) {
+        m_store->undo();
+    }
+}
+
+void Core::redoTransform()
+{
+    if (m_store) {
+        m_store->redo();
+    }
+}
+
 void Core::saveEntities()
 {
     if (m_entry && !m_entities.isEmpty()) {
@@ -264,6 +536,58 @@ void Core::saveEntities()
     }
 }
 
+void Core::benchmarkEntities()
+{
+    if (m_entities.isEmpty()) {
+        setReport(u"Load an .entities file to benchmark the writers on"_qs);
+        return;
+    }
+    // every writer formats every entity, once to warm up and then over a few passes
+    const auto timeWriter = [this](auto writer, QByteArray &result) {
+        QElapsedTimer timer;
+        for (int pass = 0; pass < 4; ++pass) {
+            if (pass == 1) {
+                timer.start();
+            }
+            result = {};
+            writer(m_entities, result);
+        }
+        return timer.nsecsElapsed() / 3;
+    };
+    QByteArray reference;
+    QByteArray direct;
+    QByteArray parallel;
+    const qint64 referenceNs = timeWriter(decl::writeReference, reference);
+    const qint64 directNs = timeWriter(
+        [](const QList<decl::Entity *> &entities, QByteArray &data) {
+            decl::format(entities, data, false);
+        },
+        direct);
+    const qint64 parallelNs = timeWriter(
+        [](const QList<decl::Entity *> &entities, QByteArray &data) {
+            decl::format(entities, data, true);
+        },
+        parallel);
+
+    // all of them have to come out byte for byte the same
+    const bool same = direct == reference && parallel == reference;
+    if (!same) {
+        qWarning() << "Entity writers disagree, reference" << reference.size() << "direct"
+                   << direct.size() << "parallel" << parallel.size() << "bytes";
+    }
+    qInfo() << "Wrote" << m_entities.count() << "entities," << reference.size()
+            << "bytes, reference" << referenceNs / 1000000.0 << "ms, direct"
+            << directNs / 1000000.0 << "ms, parallel" << parallelNs / 1000000.0 << "ms";
+    setReport(u"Wrote %1 entities: reference %2ms, direct %3ms (%4x), parallel %5ms (%6x)%7"_qs
+                  .arg(m_entities.count())
+                  .arg(referenceNs / 1000000.0, 0, 'f', 1)
+                  .arg(directNs / 1000000.0, 0, 'f', 1)
+                  .arg(referenceNs / qMax<double>(directNs, 1), 0, 'f', 1)
+                  .arg(parallelNs / 1000000.0, 0, 'f', 1)
+                  .arg(referenceNs / qMax<double>(parallelNs, 1), 0, 'f', 1)
+                  .arg(same ? QString() : u", output differs!"_qs));
+}
+
 void Core::deleteEntities(const QList<decl::Entity *> &entities)
 {
     bool changed = false;
@@ -281,24 +605,43 @@ void Core::deleteEntities(const QList<decl::Entity *> &entities)
 
 void Core::clearObjects()
 {
-    qDeleteAllLater(m_objects);
+    m_bvhDebounce->stop();
+    m_bvh.clear();
+    m_instanceModel->setStore(nullptr);
+    m_objectModel->setStore(nullptr);
+    if (m_store) {
+        m_store->deleteLater();
+        m_store = nullptr;
+    }
     m_entry = nullptr;
-    emit objectsChanged();
 }
 
-void Core::saveObject(bwm::Object *obj)
+void Core::saveObject(int object)
 {
-    if (obj) {
-        emit startSavingObject(m_entry, obj->pod());
+    if (m_store && object >= 0 && object < m_store->objectCount()) {
+        const bwm::PODObject pod = m_store->pod(object, true);
+        if (pod.matrices.isEmpty() && pod.instances.isEmpty()) {
+            setReport(u"No changes to save"_qs);
+            return;
+        }
+        emit startSavingObject(m_entry, pod);
     }
 }
 
 void Core::saveObjects()
 {
-    if (!m_objects.isEmpty()) {
+    if (m_store) {
+        // only what changed gets injected, untouched records are already in the file
         QList<bwm::PODObject> objects;
-        for (const auto obj : m_objects) {
-            objects.append(obj->pod());
+        for (qsizetype i = 0; i < m_store->objectCount(); ++i) {
+            const bwm::PODObject pod = m_store->pod(i, true);
+            if (!pod.matrices.isEmpty() || !pod.instances.isEmpty()) {
+                objects.append(pod);
+            }
+        }
+        if (objects.isEmpty()) {
+            setReport(u"No changes to save"_qs);
+            return;
         }
         emit startSavingObjects(m_entry, objects);
     }
@@ -2,12 +2,16 @@
 #define CORE_H
 
 #include <QObject>
+#include <QVector3D>
 #include <QtQml>
 
+#include "bvh.h"
 #include "bwm.h"
+#include "bwmmodel.h"
 #include "decl.h"
 #include "entry.h"
 #include "kiscule.h"
+#include "levelindex.h"
 #include "qtutils.h"
 #include "resourcemanager.h"
 
@@ -22,7 +26,8 @@ class Core : public QObject
     Q_PROPERTY(int resultCount READ resultCount NOTIFY resultsChanged)
     Q_PROPERTY(QList<Entry *> results READ results NOTIFY resultsChanged)
     Q_PROPERTY(QList<decl::Entity *> entities READ entities NOTIFY entitiesChanged)
-    Q_PROPERTY(QList<bwm::Object *> objects READ objects NOTIFY objectsChanged)
+    Q_PROPERTY(bwm::ObjectModel *objects READ objects CONSTANT)
+    Q_PROPERTY(bwm::InstanceModel *instances READ instances CONSTANT)
     Q_PROPERTY(kiscule::Root *script READ script NOTIFY scriptChanged)
 
   public:
@@ -47,9 +52,33 @@ class Core : public QObject
     const int &resultCount() const { return m_resultCount; }
     const QList<Entry *> &results() const { return m_results; }
     const QList<decl::Entity *> &entities() const { return m_entities; }
-    const QList<bwm::Object *> &objects() const { return m_objects; }
+    bwm::ObjectModel *objects() const { return m_objectModel; }
+    bwm::InstanceModel *instances() const { return m_instanceModel; }
     kiscule::Root *script() const { return m_script; }
 
+    // spatial queries over the loaded level, results are instance indexes
+    Q_INVOKABLE QList<int> instancesInBox(const QVector3D &min, const QVector3D &max);
+    Q_INVOKABLE QList<int> instancesInSphere(const QVector3D &center, float radius);
+    Q_INVOKABLE QList<int> instancesOnRay(const QVector3D &origin, const QVector3D &direction);
+    Q_INVOKABLE QList<int> nearestInstances(const QVector3D &point, int k);
+    // index of the object placing an instance, -1 if there is none
+    Q_INVOKABLE int instanceObject(int index) const;
+    // group tables of the loaded level, each group as a map of index, kind, label and size
+    Q_INVOKABLE QVariantList instanceGroups(int index) const;
+    Q_INVOKABLE QList<int> groupInstances(int group) const;
+    Q_INVOKABLE int darkVisionLayer(int index) const;
+
+    // lookups in the level index, which indexLevels builds and which is kept between runs
+    Q_INVOKABLE QStringList findMaterials(const QString &query) const;
+    Q_INVOKABLE QVariantList materialUses(const QString &material) const;
+
+    // batch edits of instance placements, each call is a single undo step, rotate
+    // and scale pivot around the middle of the selection
+    Q_INVOKABLE void translateInstances(const QList<int> &indexes, const QVector3D &offset);
+    Q_INVOKABLE void rotateInstances(const QList<int> &indexes, const QVector3D &axis,
+                                     float degrees);
+    Q_INVOKABLE void scaleInstances(const QList<int> &indexes, float factor);
+
   signals:
     void startLoadingIndexes();
     void startSearch(const QString &query);
@@ -57,13 +86,25 @@ class Core : public QObject
     void insertEntry(Entry *entry, QByteArray data);
     void exportEntry(Entry *entry, QUrl path);
     void importEntry(Entry *entry, QUrl path);
+    void importFromArchive(Entry *entry, QUrl path);
     void loadEntities(Entry *entry);
     void sortOrderChanged();
     void resultsChanged();
     void entitiesChanged();
     void exportAllEntries(QUrl path);
+    void exportUniqueEntries(QUrl path);
+    void exportArchive(QUrl path, bool withIndex);
+    void findDuplicates();
+    void startVerifying();
+    void compactResources();
+    void deployOverlay();
+    void discardOverlay();
+    void exportPatches(QUrl path);
+    void importPatches(QUrl path);
+    void benchmarkBwm();
+    void indexLevels();
     void loadBwm(Entry *entry);
-    void objectsChanged();
+    void exportMesh(Entry *entry, QUrl path);
     void startSavingObject(Entry *entry, bwm::PODObject obj);
     void startSavingObjects(Entry *entry, QList<bwm::PODObject> objects);
     void scriptChanged();
@@ -73,27 +114,42 @@ class Core : public QObject
     void sortResults(const Core::SortOrder &order);
     void loadIndexes();
     void search(const QString &query);
+    void verifyAll();
     void clear();
     void clearEntities();
     void saveEntities();
+    void benchmarkEntities();
     void deleteEntities(const QList<decl::Entity *> &entities);
     void clearObjects();
-    void saveObject(bwm::Object *obj);
+    void saveObject(int object);
     void saveObjects();
+    void undoTransform();
+    void redoTransform();
     void loadScript(const decl::EntityEntry *entry);
     void clearScript();
 
   private slots:
     void rmStatusChanged(bool busy, QString error);
+    void rmReport(QString message);
     void indexesLoaded(int containerCount, int entryCount);
     void searchResult(const QPointer<Entry> entry);
     void extractResult(const QPointer<Entry> ref, QByteArray data);
-    void entitiesLoaded(const QPointer<Entry> ref, QList<decl::Scope> entities);
-    void bwmLoaded(const QPointer<Entry> ref, QList<bwm::PODObject> objects);
+    void entitiesLoaded(const QPointer<Entry> ref, decl::Tree tree);
+    void bwmLoaded(const QPointer<Entry> ref, QList<bwm::PODObject> objects,
+                   QList<bwm::Bounds> meshBounds, bwm::Groups groups);
+    void buildBvh();
+    void levelIndexChanged(LevelIndex index);
 
   private:
+    // the tree with any pending rebuild done first
+    const Bvh &bvh();
+
     RW_PROP(QString, error, setError)
     RW_PROP(bool, busy, setBusy)
+    RW_PROP(QString, report, setReport)
+    RW_PROP(bool, useOverlay, setUseOverlay)
+    RW_PROP(int, overlayCount, setOverlayCount)
+    RW_PROP(int, indexedLevels, setIndexedLevels)
 
     RW_PROP(int, containerCount, setContainerCount)
     RW_PROP(int, entryCount, setEntryCount)
@@ -104,10 +160,15 @@ class Core : public QObject
     QPointer<ResourceManager> m_rm;
     QThread *m_rmThread;
     QTimer *m_searchResultDebounce;
+    QTimer *m_bvhDebounce;
 
     Entry *m_entry;
     QList<decl::Entity *> m_entities;
-    QList<bwm::Object *> m_objects;
+    bwm::Store *m_store;
+    bwm::ObjectModel *m_objectModel;
+    bwm::InstanceModel *m_instanceModel;
+    Bvh m_bvh;
+    LevelIndex m_levelIndex;
 
     kiscule::Root *m_script;
 };
@@ -1,47 +1,358 @@
 #include "decl.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
 #include <QVariant>
+#include <QtAlgorithms>
+#include <QtConcurrent>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define DECL_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DECL_NEON
+#endif
+
+// top level blocks are grouped so every thread gets a few runs of them to balance out
+#define PARSE_BLOCKS_PER_THREAD 4
+#define PARSE_MIN_BLOCK (1024 * 1024)
 
 namespace decl
 {
 
-EntityEntry::EntityEntry(const Entry &entry, QObject *parent)
+namespace
+{
+
+enum CharClass : quint8 {
+    Plain,
+    Skip, // whitespace and '='
+    OpenChar,
+    CloseChar,
+    EndChar,
+    Quote, // both quote characters toggle the same string state
+    Escape,
+};
+
+constexpr std::array<quint8, 256> makeClasses()
+{
+    std::array<quint8, 256> classes{};
+    classes[' '] = Skip;
+    classes['\t'] = Skip;
+    classes['\r'] = Skip;
+    classes['\n'] = Skip;
+    classes['='] = Skip;
+    classes['{'] = OpenChar;
+    classes['}'] = CloseChar;
+    classes[';'] = EndChar;
+    classes['"'] = Quote;
+    classes['\''] = Quote;
+    classes['\\'] = Escape;
+    return classes;
+}
+
+constexpr std::array<quint8, 256> classes = makeClasses();
+
+inline quint8 classOf(const char c) { return classes[static_cast<quint8>(c)]; }
+
+// next brace, quote or escape at or after i
+qsizetype nextBlockChar(const char *p, qsizetype i, const qsizetype n)
+{
+#if defined(DECL_SSE)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hits = _mm_cmpeq_epi8(v, _mm_set1_epi8('{'));
+        for (const char c : {'}', '"', '\'', '\\'}) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+        }
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask) {
+            return i + qCountTrailingZeroBits(static_cast<quint32>(mask));
+        }
+    }
+#elif defined(DECL_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        uint8x16_t hits = vceqq_u8(v, vdupq_n_u8('{'));
+        for (const char c : {'}', '"', '\'', '\\'}) {
+            hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(c))));
+        }
+        if (vmaxvq_u8(hits)) {
+            break;
+        }
+    }
+#endif
+    while (i < n) {
+        const quint8 c = classOf(p[i]);
+        if (c == OpenChar || c == CloseChar || c == Quote || c == Escape) {
+            break;
+        }
+        ++i;
+    }
+    return i;
+}
+
+// indentation is copied out of here, deeper scopes take more than one copy
+constexpr char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+constexpr int tabCount = sizeof(tabs) - 1;
+
+char *indent(char *out, int depth)
+{
+    while (depth > 0) {
+        const int n = qMin(depth, tabCount);
+        std::memcpy(out, tabs, n);
+        out += n;
+        depth -= n;
+    }
+    return out;
+}
+
+template<qsizetype N>
+char *copy(char *out, const char (&text)[N])
+{
+    std::memcpy(out, text, N - 1);
+    return out + N - 1;
+}
+
+// UTF-16 units at and after i that are ASCII, only checked 8 at a time
+qsizetype asciiRun(const char16_t *p, const qsizetype i, const qsizetype n)
+{
+    qsizetype j = i;
+#if defined(DECL_SSE)
+    for (; j + 8 <= n; j += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + j));
+        const __m128i high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xff80)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xffff) {
+            break;
+        }
+    }
+#elif defined(DECL_NEON)
+    for (; j + 8 <= n; j += 8) {
+        if (vmaxvq_u16(vld1q_u16(reinterpret_cast<const uint16_t *>(p + j))) >= 0x80) {
+            break;
+        }
+    }
+#else
+    Q_UNUSED(p)
+    Q_UNUSED(n)
+#endif
+    return j - i;
+}
+
+// bytes QString::toUtf8 makes out of s, broken surrogates become a single '?' like there
+qsizetype utf8Size(const QString &s)
+{
+    const char16_t *p = reinterpret_cast<const char16_t *>(s.utf16());
+    const qsizetype n = s.size();
+    qsizetype size = n;
+    for (qsizetype i = 0; i < n; ++i) {
+        i += asciiRun(p, i, n);
+        if (i >= n) {
+            break;
+        }
+        const char16_t c = p[i];
+        if (c < 0x80 || QChar::isSurrogate(c)) {
+            if (QChar::isHighSurrogate(c) && i + 1 < n && QChar::isLowSurrogate(p[i + 1])) {
+                size += 2;
+                ++i;
+            }
+        } else {
+            size += c < 0x800 ? 1 : 2;
+        }
+    }
+    return size;
+}
+
+char *appendUtf8(char *out, const QString &s)
+{
+    const char16_t *p = reinterpret_cast<const char16_t *>(s.utf16());
+    const qsizetype n = s.size();
+    qsizetype i = 0;
+    while (i < n) {
+        const qsizetype run = asciiRun(p, i, n);
+#if defined(DECL_SSE)
+        for (qsizetype k = 0; k < run; k += 8) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + k));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out + k), _mm_packus_epi16(v, v));
+        }
+#elif defined(DECL_NEON)
+        for (qsizetype k = 0; k < run; k += 8) {
+            vst1_u8(reinterpret_cast<uint8_t *>(out + k),
+                    vmovn_u16(vld1q_u16(reinterpret_cast<const uint16_t *>(p + i + k))));
+        }
+#endif
+        out += run;
+        i += run;
+        if (i >= n) {
+            break;
+        }
+        const char16_t c = p[i++];
+        if (c < 0x80) {
+            *out++ = static_cast<char>(c);
+        } else if (c < 0x800) {
+            *out++ = static_cast<char>(0xc0 | (c >> 6));
+            *out++ = static_cast<char>(0x80 | (c & 0x3f));
+        } else if (!QChar::isSurrogate(c)) {
+            *out++ = static_cast<char>(0xe0 | (c >> 12));
+            *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+            *out++ = static_cast<char>(0x80 | (c & 0x3f));
+        } else if (QChar::isHighSurrogate(c) && i < n && QChar::isLowSurrogate(p[i])) {
+            const char32_t u = QChar::surrogateToUcs4(c, p[i++]);
+            *out++ = static_cast<char>(0xf0 | (u >> 18));
+            *out++ = static_cast<char>(0x80 | ((u >> 12) & 0x3f));
+            *out++ = static_cast<char>(0x80 | ((u >> 6) & 0x3f));
+            *out++ = static_cast<char>(0x80 | (u & 0x3f));
+        } else {
+            *out++ = '?';
+        }
+    }
+    return out;
+}
+
+// the original formatting through QString, kept to check and benchmark format against
+void appendReference(const EntityEntry *entry, QByteArray &stream, const int depth)
+{
+    const QString prefix(depth, '\t');
+    if (!entry->value().isEmpty()) {
+        stream.append(u"%1%2 = %3;\n"_qs.arg(prefix, entry->key(), entry->value()).toUtf8());
+    } else if (const auto entries = entry->entries(); !entries.isEmpty()) {
+        stream.append(u"%1%2 = {\n"_qs.arg(prefix, entry->key()).toUtf8());
+        for (const auto e : entries) {
+            appendReference(e, stream, depth + 1);
+        }
+        stream.append(u"%1}\n"_qs.arg(prefix).toUtf8());
+    } else {
+        // NOTE: some entries in the game are scopes with no child entries
+        //       this just places them back in...
+        stream.append(u"%1%2 = {}\n"_qs.arg(prefix, entry->key()).toUtf8());
+    }
+}
+
+} // namespace
+
+QByteArrayView Tree::valueView(const qint32 index) const
+{
+    const Node &n = m_nodes.at(index);
+    return n.valueLength < 0 ? QByteArrayView()
+                             : QByteArrayView(m_source).sliced(n.valueStart, n.valueLength);
+}
+
+qint32 Tree::intern(const QByteArrayView key)
+{
+    // looked up without a copy, only new keys get one
+    const auto it = m_keyIndexes.constFind(QByteArray::fromRawData(key.data(), key.size()));
+    if (it != m_keyIndexes.cend()) {
+        return *it;
+    }
+    const qint32 index = static_cast<qint32>(m_keys.count());
+    m_keys.append(QString::fromUtf8(key));
+    m_keyIndexes.insert(key.toByteArray(), index);
+    return index;
+}
+
+EntityEntry::EntityEntry(QObject *parent)
+    : QObject(parent)
+    , m_key()
+    , m_value()
+    , m_entries()
+    , m_isKiscule(false)
+{
+}
+
+EntityEntry::EntityEntry(const Tree &tree, const qint32 node, QObject *parent)
     : QObject(parent)
-    , m_key(entry.first)
+    , m_key(tree.key(node))
     , m_value()
     , m_entries()
     , m_isKiscule(false)
 {
-    if (entry.second.canConvert<Scope>()) {
-        if (entry.first == u"m_kiscule"_qs) {
+    if (tree.isScope(node)) {
+        if (m_key == u"m_kiscule"_qs) {
             m_isKiscule = true;
         }
-        const Scope scope = entry.second.value<Scope>();
-        for (const auto &e : scope) {
-            m_entries.append(new EntityEntry(e, this));
+        for (qint32 c = tree.node(node).firstChild; c >= 0; c = tree.node(c).nextSibling) {
+            m_entries.append(new EntityEntry(tree, c, this));
         }
     } else {
-        m_value = entry.second.toString();
+        m_value = tree.value(node);
+    }
+}
+
+void EntityEntry::setKey(const QString &key)
+{
+    if (m_key == key) {
+        return;
+    }
+    m_key = key;
+    markDirty();
+    emit keyChanged(m_key);
+}
+
+void EntityEntry::setValue(const QString &value)
+{
+    if (m_value == value) {
+        return;
+    }
+    m_value = value;
+    markDirty();
+    emit valueChanged(m_value);
+}
+
+void EntityEntry::markDirty()
+{
+    // entries hang off their entity through their scopes' QObject parents
+    for (QObject *o = parent(); o; o = o->parent()) {
+        if (const auto entity = qobject_cast<Entity *>(o)) {
+            entity->markDirty();
+            return;
+        }
     }
 }
 
 void EntityEntry::toByteArray(QByteArray &stream, const int &depth) const
 {
-    const QString prefix(depth, '\t');
+    const qsizetype start = stream.size();
+    stream.resize(start + formattedSize(depth));
+    format(stream.data() + start, depth);
+}
+
+qsizetype EntityEntry::formattedSize(const int depth) const
+{
+    const qsizetype key = depth + utf8Size(m_key);
     if (!m_value.isEmpty()) {
-        stream.append(u"%1%2 = %3;\n"_qs.arg(prefix, m_key, m_value).toUtf8());
-    } else if (!m_entries.isEmpty()) {
-        stream.append(u"%1%2 = {\n"_qs.arg(prefix, m_key).toUtf8());
-        for (const auto e : m_entries) {
-            e->toByteArray(stream, depth + 1);
-        }
-        stream.append(u"%1}\n"_qs.arg(prefix).toUtf8());
-    } else {
+        return key + 5 + utf8Size(m_value); // " = " ";\n"
+    }
+    if (m_entries.isEmpty()) {
+        return key + 6; // " = {}\n"
+    }
+    qsizetype size = key + 5 + depth + 2; // " = {\n" "}\n"
+    for (const auto e : m_entries) {
+        size += e->formattedSize(depth + 1);
+    }
+    return size;
+}
+
+char *EntityEntry::format(char *out, const int depth) const
+{
+    out = appendUtf8(indent(out, depth), m_key);
+    if (!m_value.isEmpty()) {
+        return copy(appendUtf8(copy(out, " = "), m_value), ";\n");
+    }
+    if (m_entries.isEmpty()) {
         // NOTE: some entries in the game are scopes with no child entries
         //       this just places them back in...
-        stream.append(u"%1%2 = {}\n"_qs.arg(prefix, m_key).toUtf8());
+        return copy(out, " = {}\n");
+    }
+    out = copy(out, " = {\n");
+    for (const auto e : m_entries) {
+        out = e->format(out, depth + 1);
     }
+    return copy(indent(out, depth), "}\n");
 }
 
 QVariantMap EntityEntry::toMap() const
@@ -68,32 +379,44 @@ void EntityEntry::deleteEntry(decl::EntityEntry *entry)
     if (m_entries.contains(entry)) {
         entry->deleteLater();
         m_entries.removeAll(entry);
+        markDirty();
         emit entriesChanged(m_entries);
     }
 }
 
 void EntityEntry::addEntry()
 {
-    m_entries.append(new EntityEntry(Entry(), this));
+    m_entries.append(new EntityEntry(this));
+    markDirty();
     emit entriesChanged(m_entries);
 }
 
-Entity::Entity(const Scope &scope, QObject *parent)
+Entity::Entity(const Tree &tree, const qsizetype entity, QObject *parent)
     : QObject(parent)
+    , m_source(tree.source())
+    , m_range(tree.range(entity))
+    , m_dirty(false)
     , m_entityId()
     , m_entityType()
     , m_definitionType()
     , m_entries()
 {
-    for (const auto &e : scope) {
-        if (e.first == u"entityId"_qs) {
-            m_entityId = e.second.toString();
-        } else if (e.first == u"entityType"_qs) {
-            m_entityType = e.second.toString();
-        } else if (e.first == u"definitionType"_qs) {
-            m_definitionType = e.second.toString();
+    // the header isn't edited from the UI, so a connection per entity is cheap enough
+    for (const auto changed : {&Entity::entityIdChanged, &Entity::entityTypeChanged,
+                               &Entity::definitionTypeChanged}) {
+        connect(this, changed, this, &Entity::markDirty);
+    }
+    const qint32 root = tree.entities().at(entity);
+    for (qint32 c = tree.node(root).firstChild; c >= 0; c = tree.node(c).nextSibling) {
+        const QString &key = tree.key(c);
+        if (key == u"entityId"_qs) {
+            m_entityId = tree.value(c);
+        } else if (key == u"entityType"_qs) {
+            m_entityType = tree.value(c);
+        } else if (key == u"definitionType"_qs) {
+            m_definitionType = tree.value(c);
         } else {
-            m_entries.append(new EntityEntry(e, this));
+            m_entries.append(new EntityEntry(tree, c, this));
         }
     }
 }
@@ -103,13 +426,44 @@ bool Entity::isValid() const
     return !m_entityId.isEmpty() && !m_entityType.isEmpty() && !m_definitionType.isEmpty();
 }
 
+QByteArrayView Entity::source() const
+{
+    return QByteArrayView(m_source).sliced(m_range.start, m_range.end - m_range.start);
+}
+
+void Entity::setSource(const QByteArray &source, const qsizetype start, const qsizetype end)
+{
+    m_source = source;
+    m_range = {start, end};
+    m_dirty = false;
+}
+
 void Entity::toByteArray(QByteArray &stream) const
 {
-    stream.append(u"%1 {\n\t%2 %3 {\n"_qs.arg(m_definitionType, m_entityType, m_entityId).toUtf8());
+    const qsizetype start = stream.size();
+    stream.resize(start + formattedSize());
+    format(stream.data() + start);
+}
+
+qsizetype Entity::formattedSize() const
+{
+    // "%1 {\n\t%2 %3 {\n" and "\t}\n}\n"
+    qsizetype size = utf8Size(m_definitionType) + utf8Size(m_entityType)
+                     + utf8Size(m_entityId) + 13;
     for (const auto e : m_entries) {
-        e->toByteArray(stream, 2);
+        size += e->formattedSize(2);
     }
-    stream.append("\t}\n}\n");
+    return size;
+}
+
+char *Entity::format(char *out) const
+{
+    out = copy(appendUtf8(out, m_definitionType), " {\n\t");
+    out = copy(appendUtf8(copy(appendUtf8(out, m_entityType), " "), m_entityId), " {\n");
+    for (const auto e : m_entries) {
+        out = e->format(out, 2);
+    }
+    return copy(out, "\t}\n}\n");
 }
 
 void Entity::deleteEntry(decl::EntityEntry *entry)
@@ -117,129 +471,448 @@ void Entity::deleteEntry(decl::EntityEntry *entry)
     if (m_entries.contains(entry)) {
         entry->deleteLater();
         m_entries.removeAll(entry);
+        m_dirty = true;
         emit entriesChanged(m_entries);
     }
 }
 
 void Entity::addEntry()
 {
-    m_entries.append(new EntityEntry(Entry(), this));
+    m_entries.append(new EntityEntry(this));
+    m_dirty = true;
     emit entriesChanged(m_entries);
 }
 
-QString parse(const QByteArray &data, QList<Scope> &entities)
+Lexer::Lexer(QByteArrayView input, qsizetype pos)
+    : m_input(input)
+    , m_pos(pos)
 {
-    qInfo() << "Started parsing entities...";
-    if (data.first(9) != QByteArrayLiteral("Version 6")) {
-        return u"Unknown header!"_qs;
+}
+
+qsizetype Lexer::skipPlain(qsizetype i) const
+{
+    // first byte that isn't plain, 16 at a time against every special character
+    const char *p = m_input.data();
+    const qsizetype n = m_input.size();
+#if defined(DECL_SSE)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hits = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        for (const char c : {'\t', '\r', '\n', '=', '{', '}', ';', '"', '\'', '\\'}) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+        }
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask) {
+            return i + qCountTrailingZeroBits(static_cast<quint32>(mask));
+        }
     }
-    QByteArray token;
-    QList<QByteArray> tokens;
-    QList<Scope> stack;
-    bool inEscape = false;
+#elif defined(DECL_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        uint8x16_t hits = vceqq_u8(v, vdupq_n_u8(' '));
+        for (const char c : {'\t', '\r', '\n', '=', '{', '}', ';', '"', '\'', '\\'}) {
+            hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(c))));
+        }
+        if (vmaxvq_u8(hits)) {
+            break;
+        }
+    }
+#endif
+    while (i < n && classOf(p[i]) == Plain) {
+        ++i;
+    }
+    return i;
+}
+
+qsizetype Lexer::skipString(qsizetype i) const
+{
+    // inside a string only quotes and escapes matter
+    const char *p = m_input.data();
+    const qsizetype n = m_input.size();
+#if defined(DECL_SSE)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        const __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\''))),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask) {
+            return i + qCountTrailingZeroBits(static_cast<quint32>(mask));
+        }
+    }
+#elif defined(DECL_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        const uint8x16_t hits = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\''))),
+            vceqq_u8(v, vdupq_n_u8('\\')));
+        if (vmaxvq_u8(hits)) {
+            break;
+        }
+    }
+#endif
+    while (i < n && classOf(p[i]) != Quote && classOf(p[i]) != Escape) {
+        ++i;
+    }
+    return i;
+}
+
+Token Lexer::next()
+{
+    const char *p = m_input.data();
+    const qsizetype n = m_input.size();
+    while (m_pos < n && classOf(p[m_pos]) == Skip) {
+        ++m_pos;
+    }
+    const qsizetype start = m_pos;
+    if (m_pos >= n) {
+        return {Token::Eof, {}, start};
+    }
+    switch (classOf(p[m_pos])) {
+    case OpenChar:
+        return {Token::Open, m_input.sliced(m_pos++, 1), start};
+    case CloseChar:
+        return {Token::Close, m_input.sliced(m_pos++, 1), start};
+    case EndChar:
+        return {Token::End, m_input.sliced(m_pos++, 1), start};
+    default:
+        break;
+    }
+    // a word runs until a separator outside of a string, escapes are kept since the
+    // value might get written back out unmodified
     bool inString = false;
-    for (int i = 9; i < data.size(); ++i) {
-        const auto c = data[i];
-        // shortcut escape sequences
-        if (inEscape) {
-            token.append(c);
-            inEscape = false;
-            continue;
-        } else if (c == '\\') {
-            // keep escape since we might write this back out unmodified
-            token.append(c);
-            inEscape = true;
-            continue;
+    while (m_pos < n) {
+        const quint8 c = classOf(p[m_pos]);
+        if (c == Escape) {
+            m_pos = qMin(m_pos + 2, n);
+        } else if (c == Quote) {
+            inString = !inString;
+            ++m_pos;
+        } else if (inString) {
+            m_pos = skipString(m_pos);
+        } else if (c == Plain) {
+            m_pos = skipPlain(m_pos);
+        } else {
+            break;
         }
-        // shortcut characters within a string and string toggles
-        if (inString || c == '"' || c == '\'') {
-            token.append(c);
-            if (c == '"' || c == '\'') {
-                inString = !inString;
-            }
-            continue;
+    }
+    return {Token::Word, m_input.sliced(start, m_pos - start), start};
+}
+
+QString Tree::parseBlocks(const QByteArray &data, const qsizetype begin, const qsizetype end,
+                          Tree &tree)
+{
+    tree = {};
+    tree.m_source = data;
+    QList<Tree::Node> &nodes = tree.m_nodes;
+    // open scopes with their last child so far, new children get linked in after it
+    struct Frame {
+        qint32 node;
+        qint32 lastChild;
+    };
+    QList<Frame> stack;
+    const auto link = [&nodes](Frame &frame, const qint32 child) {
+        if (frame.lastChild < 0) {
+            nodes[frame.node].firstChild = child;
+        } else {
+            nodes[frame.lastChild].nextSibling = child;
         }
-        // detect end of token and insert it into token cache
-        if (!token.isEmpty() && QByteArrayLiteral(" \t\r\n={};").contains(c)) {
-            tokens.append(token);
-            token.clear();
+        frame.lastChild = child;
+    };
+    const auto addValue = [&](Frame &frame, const qint32 key, const QByteArrayView value) {
+        nodes.append({key, -1, -1, static_cast<qint32>(value.size()), value.data() - data.data()});
+        link(frame, static_cast<qint32>(nodes.count() - 1));
+    };
+    const auto addScope = [&nodes](const qint32 key) {
+        nodes.append({key, -1, -1, -1, 0});
+        return Frame{static_cast<qint32>(nodes.count() - 1), -1};
+    };
+
+    // an entity's range runs through the rest of the line its closing brace is on, so
+    // copying it back out keeps the line break
+    const auto lineEnd = [&data](qsizetype i) {
+        const qsizetype close = i;
+        while (i < data.size() && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r')) {
+            ++i;
         }
-        switch (c) {
-        // skip these control characters
-        case ' ':
-        case '\t':
-        case '\r':
-        case '\n':
-        case '=': {
+        return i < data.size() && data[i] == '\n' ? i + 1 : close;
+    };
+
+    Lexer lexer(QByteArrayView(data).first(end), begin);
+    QList<QByteArrayView> tokens;
+    qsizetype entityStart = 0;
+    for (Token t = lexer.next(); t.kind != Token::Eof; t = lexer.next()) {
+        switch (t.kind) {
+        case Token::Word: {
+            tokens.append(t.text);
             break;
         }
         // handle value end marker
-        case ';': {
+        case Token::End: {
             if (stack.isEmpty()) {
-                return u"Missing stack frame for key-value pair @ %1"_qs.arg(i);
+                return u"Missing stack frame for key-value pair @ %1"_qs.arg(t.pos);
             }
             if (tokens.isEmpty()) {
-                return u"Missing tokens for key-value pair @ %1"_qs.arg(i);
+                return u"Missing tokens for key-value pair @ %1"_qs.arg(t.pos);
             }
             // NOTE: some values have a key that is made up of 2+ tokens
             // we just combine them into 1 key string for now
-            QByteArray value = tokens.takeLast();
-            const int keyStart = stack.count() - 1;
-            const int keyEnd = tokens.count() - 1;
-            QByteArray key;
-            for (int ki = keyEnd; ki >= keyStart; ki--) {
-                key.prepend((ki == keyStart ? "" : " ") + tokens.takeAt(ki));
+            const QByteArrayView value = tokens.takeLast();
+            const qsizetype keyStart = qMin(stack.count() - 1, tokens.count());
+            qint32 key;
+            if (tokens.count() - keyStart == 1) {
+                key = tree.intern(tokens[keyStart]);
+            } else {
+                QByteArray joined;
+                for (qsizetype ki = keyStart; ki < tokens.count(); ++ki) {
+                    if (ki != keyStart) {
+                        joined.append(' ');
+                    }
+                    joined.append(tokens[ki]);
+                }
+                key = tree.intern(joined);
             }
-            stack.last().append({QString(key), QString(value)});
+            tokens.resize(keyStart);
+            addValue(stack.last(), key, value);
             break;
         }
-        // handle start of nested scope
-        case '{': {
+        // handle start of nested scope, its key only shows up once it is closed
+        case Token::Open: {
             if (stack.isEmpty() && tokens.count() == 3) {
-                stack.append({
-                    {u"entityId"_qs, QString(tokens.takeLast())},
-                    {u"entityType"_qs, QString(tokens.takeLast())},
-                    {u"definitionType"_qs, QString(tokens.takeLast())},
-                });
+                entityStart = tokens[0].data() - data.data();
+                stack.append(addScope(tree.intern({})));
+                addValue(stack.last(), tree.intern("entityId"), tokens[2]);
+                addValue(stack.last(), tree.intern("entityType"), tokens[1]);
+                addValue(stack.last(), tree.intern("definitionType"), tokens[0]);
+                tokens.clear();
             } else if (!stack.isEmpty()) {
-                stack.append(Scope());
+                stack.append(addScope(-1));
             }
             break;
         }
         // handle exiting nested scope
-        case '}': {
+        case Token::Close: {
             if (stack.count() == 1 && tokens.isEmpty()) {
-                entities.append(stack.takeLast());
+                tree.m_entities.append(stack.takeLast().node);
+                tree.m_ranges.append({entityStart, lineEnd(t.pos + 1)});
             } else if (stack.count() > 1 && !tokens.isEmpty()) {
-                QVariant scope = QVariant::fromValue(stack.takeLast());
-                stack.last().append({QString(tokens.takeLast()), scope});
+                const Frame scope = stack.takeLast();
+                nodes[scope.node].key = tree.intern(tokens.takeLast());
+                link(stack.last(), scope.node);
             }
             break;
         }
-        default: {
-            token.append(c);
+        case Token::Eof:
             break;
         }
-        }
     }
     if (!stack.isEmpty() || !tokens.isEmpty()) {
         return u"Bad entities, leftover data!"_qs;
     }
-    qInfo() << "Loaded entities:" << entities.count();
     return {};
 }
 
-void write(const QList<Entity *> &entities, QByteArray &stream)
+void Tree::append(const Tree &other)
+{
+    const qint32 offset = static_cast<qint32>(m_nodes.count());
+    const auto shift = [offset](const qint32 index) { return index < 0 ? index : index + offset; };
+    QList<qint32> keys(other.m_keys.count());
+    for (auto it = other.m_keyIndexes.cbegin(); it != other.m_keyIndexes.cend(); ++it) {
+        keys[it.value()] = intern(it.key());
+    }
+    m_nodes.reserve(m_nodes.count() + other.m_nodes.count());
+    for (Node n : other.m_nodes) {
+        n.key = n.key < 0 ? n.key : keys[n.key];
+        n.firstChild = shift(n.firstChild);
+        n.nextSibling = shift(n.nextSibling);
+        m_nodes.append(n);
+    }
+    for (const qint32 root : other.m_entities) {
+        m_entities.append(root + offset);
+    }
+    // ranges are offsets into the whole source already
+    m_ranges.append(other.m_ranges);
+}
+
+namespace
+{
+
+QList<qsizetype> splitBlocks(const QByteArrayView input, const qsizetype begin,
+                             const qsizetype target)
+{
+    // cut after the first top level '}' past every target bytes, braces inside strings
+    // or behind an escape don't count, the same way the lexer sees them
+    const char *p = input.data();
+    const qsizetype n = input.size();
+    QList<qsizetype> cuts{begin};
+    qsizetype depth = 0;
+    bool inString = false;
+    for (qsizetype i = nextBlockChar(p, begin, n); i < n; i = nextBlockChar(p, i, n)) {
+        switch (classOf(p[i])) {
+        case Escape:
+            i += 2;
+            continue;
+        case Quote:
+            inString = !inString;
+            break;
+        case OpenChar:
+            depth += inString ? 0 : 1;
+            break;
+        case CloseChar:
+            if (!inString && depth > 0 && --depth == 0 && i + 1 - cuts.last() >= target) {
+                cuts.append(i + 1);
+            }
+            break;
+        default:
+            break;
+        }
+        ++i;
+    }
+    if (cuts.last() != n) {
+        cuts.append(n);
+    }
+    return cuts;
+}
+
+} // namespace
+
+QString parse(const QByteArray &data, Tree &tree)
+{
+    qInfo() << "Started parsing entities...";
+    QElapsedTimer timer;
+    timer.start();
+    tree = {};
+    if (!data.startsWith("Version 6")) {
+        return u"Unknown header!"_qs;
+    }
+    // entities don't share any state, so runs of them parse on their own and the
+    // trees get stitched back together in file order
+    const qsizetype target = qMax<qsizetype>(
+        data.size() / (QThread::idealThreadCount() * PARSE_BLOCKS_PER_THREAD), PARSE_MIN_BLOCK);
+    const QList<qsizetype> cuts = splitBlocks(data, 9, target);
+    QList<Tree> parts(cuts.count() - 1);
+    QStringList errors(parts.count());
+    QList<qsizetype> jobs(parts.count());
+    std::iota(jobs.begin(), jobs.end(), 0);
+    Tree *out = parts.data();
+    QString *errorOut = errors.data();
+    QtConcurrent::blockingMap(jobs, [&](const qsizetype i) {
+        errorOut[i] = Tree::parseBlocks(data, cuts[i], cuts[i + 1], out[i]);
+    });
+    for (const auto &error : qAsConst(errors)) {
+        if (!error.isEmpty()) {
+            return error;
+        }
+    }
+    if (parts.count() == 1) {
+        tree = parts.first();
+    } else {
+        tree.m_source = data;
+        for (const auto &part : qAsConst(parts)) {
+            tree.append(part);
+        }
+    }
+    qInfo() << "Loaded entities:" << tree.m_entities.count() << "in" << tree.m_nodes.count()
+            << "nodes from" << parts.count() << "blocks in" << timer.elapsed() << "ms";
+    return {};
+}
+
+namespace
+{
+
+struct Piece {
+    Entity *entity;
+    QByteArrayView copy; // source bytes of a clean entity, empty when it gets formatted
+    qsizetype start;
+    qsizetype size;
+};
+
+// sizes are exact, so after one allocation every entity is written into its own span
+// of stream, on as many threads as there are when parallel
+QList<Piece> serialize(const QList<Entity *> &entities, QByteArray &stream, const bool splice,
+                       const bool parallel)
+{
+    QList<Piece> pieces;
+    pieces.reserve(entities.count());
+    for (const auto e : entities) {
+        if (e->isValid()) {
+            pieces.append({e, splice && !e->isDirty() ? e->source() : QByteArrayView(), 0, 0});
+        }
+    }
+    const auto run = [parallel, &pieces](auto &&f) {
+        if (parallel) {
+            QtConcurrent::blockingMap(pieces, f);
+        } else {
+            std::for_each(pieces.begin(), pieces.end(), f);
+        }
+    };
+    run([](Piece &p) {
+        // the last entity in a file might not have a line break after it
+        p.size = p.copy.isEmpty() ? p.entity->formattedSize()
+                                  : p.copy.size() + (p.copy.endsWith('\n') ? 0 : 1);
+    });
+    const qsizetype header = stream.size();
+    qsizetype size = header + 10;
+    for (auto &p : pieces) {
+        p.start = size;
+        size += p.size;
+    }
+    stream.resize(size);
+    char *out = stream.data();
+    std::memcpy(out + header, "Version 6\n", 10);
+    run([out](Piece &p) {
+        if (p.copy.isEmpty()) {
+            p.entity->format(out + p.start);
+            return;
+        }
+        std::memcpy(out + p.start, p.copy.data(), p.copy.size());
+        if (p.size > p.copy.size()) {
+            out[p.start + p.size - 1] = '\n';
+        }
+    });
+    return pieces;
+}
+
+} // namespace
+
+void write(const QList<Entity *> &entities, QByteArray &stream, const bool parallel)
 {
     qInfo() << "Started writing entities...";
+    QElapsedTimer timer;
+    timer.start();
+    const QList<Piece> pieces = serialize(entities, stream, true, parallel);
+    // sharing the result only once it's complete, writing to shared data would copy
+    qsizetype copied = 0;
+    for (const auto &p : pieces) {
+        copied += p.copy.isEmpty() ? 0 : 1;
+        p.entity->setSource(stream, p.start, p.start + p.size);
+    }
+    qInfo() << "Wrote entities:" << stream.size() << "bytes," << copied << "of"
+            << pieces.count() << "copied as is in" << timer.elapsed() << "ms";
+}
+
+void format(const QList<Entity *> &entities, QByteArray &stream, const bool parallel)
+{
+    serialize(entities, stream, false, parallel);
+}
+
+void writeReference(const QList<Entity *> &entities, QByteArray &stream)
+{
     stream.append("Version 6\n");
     for (const auto e : entities) {
         if (!e->isValid()) {
             continue;
         }
-        e->toByteArray(stream);
+        stream.append(u"%1 {\n\t%2 %3 {\n"_qs
+                          .arg(e->definitionType(), e->entityType(), e->entityId())
+                          .toUtf8());
+        const auto entries = e->entries();
+        for (const auto entry : entries) {
+            appendReference(entry, stream, 2);
+        }
+        stream.append("\t}\n}\n");
     }
-    qInfo() << "Wrote entities:" << stream.size();
 }
 
 } // namespace decl
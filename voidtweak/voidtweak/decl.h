@@ -9,10 +9,56 @@
 namespace decl
 {
 
-// these are used for passing around and serializing entities when a full QObject
-// version is not a good fit (between threads, etc.)
-using Entry = QPair<QString, QVariant>;
-using Scope = QList<Entry>;
+// a parsed decl file, used for passing entities around when a full QObject version is
+// not a good fit (between threads, etc.). Every scope and value is a node in one
+// contiguous array linked through first child and next sibling, keys are interned and
+// values stay spans of the source until something asks for them.
+class Tree
+{
+  public:
+    struct Node {
+        qint32 key = -1;
+        qint32 firstChild = -1;
+        qint32 nextSibling = -1;
+        qint32 valueLength = -1; // -1 for scopes
+        qsizetype valueStart = 0;
+    };
+    // bytes of one entity in the source, from its header through the line its closing
+    // brace is on
+    struct Range {
+        qsizetype start = 0;
+        qsizetype end = 0;
+    };
+
+    // root scope of each entity, its first children are entityId, entityType and
+    // definitionType
+    const QList<qint32> &entities() const { return m_entities; }
+    const Range &range(qsizetype entity) const { return m_ranges.at(entity); }
+    const QByteArray &source() const { return m_source; }
+    qsizetype count() const { return m_nodes.count(); }
+    const Node &node(qint32 index) const { return m_nodes.at(index); }
+    bool isScope(qint32 index) const { return m_nodes.at(index).valueLength < 0; }
+    const QString &key(qint32 index) const { return m_keys.at(m_nodes.at(index).key); }
+    QByteArrayView valueView(qint32 index) const;
+    QString value(qint32 index) const { return QString::fromUtf8(valueView(index)); }
+
+  private:
+    friend QString parse(const QByteArray &data, Tree &tree);
+    // parses the top level blocks in [begin, end) of data into tree, node values keep
+    // their offsets into all of data
+    static QString parseBlocks(const QByteArray &data, qsizetype begin, qsizetype end,
+                               Tree &tree);
+    // moves the nodes of other in after this tree's, with other's keys interned here
+    void append(const Tree &other);
+    qint32 intern(QByteArrayView key);
+
+    QByteArray m_source;
+    QList<Node> m_nodes;
+    QStringList m_keys;
+    QHash<QByteArray, qint32> m_keyIndexes;
+    QList<qint32> m_entities;
+    QList<Range> m_ranges;
+};
 
 class EntityEntry : public QObject
 {
@@ -21,20 +67,38 @@ class EntityEntry : public QObject
     QML_UNCREATABLE("Backend only.")
 
     Q_PROPERTY(QObject *scope READ parent CONSTANT)
+    // written by hand instead of RW_PROP since edits mark the owning entity dirty
+    Q_PROPERTY(QString key READ key WRITE setKey NOTIFY keyChanged)
+    Q_PROPERTY(QString value READ value WRITE setValue NOTIFY valueChanged)
 
   public:
-    explicit EntityEntry(const Entry &entry, QObject *parent);
+    explicit EntityEntry(QObject *parent);
+    explicit EntityEntry(const Tree &tree, qint32 node, QObject *parent);
     bool isLeaf() const { return m_entries.isEmpty(); }
     void toByteArray(QByteArray &stream, const int &depth = 0) const;
+    // exact UTF-8 size of what format writes, format returns the end of what it wrote
+    qsizetype formattedSize(int depth) const;
+    char *format(char *out, int depth) const;
     QVariantMap toMap() const;
+    const QString &key() const { return m_key; }
+    const QString &value() const { return m_value; }
 
   public slots:
     void deleteEntry(decl::EntityEntry *entry);
     void addEntry();
+    void setKey(const QString &key);
+    void setValue(const QString &value);
+
+  signals:
+    void keyChanged(const QString &key);
+    void valueChanged(const QString &value);
 
   private:
-    RW_PROP(QString, key, setKey)
-    RW_PROP(QString, value, setValue)
+    void markDirty();
+
+    QString m_key;
+    QString m_value;
+
     RW_PROP(QList<EntityEntry *>, entries, setEntries)
     RW_PROP(bool, isKiscule, setIsKiscule)
 };
@@ -46,26 +110,80 @@ class Entity : public QObject
     QML_UNCREATABLE("Backend only.")
 
   public:
-    explicit Entity(const Scope &scope, QObject *parent);
+    // entity is an index into tree.entities()
+    explicit Entity(const Tree &tree, qsizetype entity, QObject *parent);
     bool isValid() const;
     void toByteArray(QByteArray &stream) const;
+    qsizetype formattedSize() const;
+    char *format(char *out) const;
+
+    // an entity that hasn't been edited since it was read gets its source bytes written
+    // back out as is
+    bool isDirty() const { return m_dirty; }
+    void markDirty() { m_dirty = true; }
+    QByteArrayView source() const;
+    // source is shared, not copied, and the entity counts as clean again
+    void setSource(const QByteArray &source, qsizetype start, qsizetype end);
 
   public slots:
     void deleteEntry(decl::EntityEntry *entry);
     void addEntry();
 
   private:
+    QByteArray m_source;
+    Tree::Range m_range;
+    bool m_dirty;
+
     RW_PROP(QString, entityId, setEntityId)
     RW_PROP(QString, entityType, setEntityType)
     RW_PROP(QString, definitionType, setDefinitionType)
     RW_PROP(QList<EntityEntry *>, entries, setEntries)
 };
 
+// a word, a scope bracket or a value end. Words are views into the input with their
+// quotes and escapes left in, they only become strings once something needs one
+struct Token {
+    enum Kind {
+        Word,
+        Open,  // {
+        Close, // }
+        End,   // ;
+        Eof,
+    };
+    Kind kind;
+    QByteArrayView text;
+    qsizetype pos;
+};
+
+// splits decl text into tokens without copying, whitespace and '=' only separate words
+class Lexer
+{
+  public:
+    explicit Lexer(QByteArrayView input, qsizetype pos = 0);
+    Token next();
+    qsizetype pos() const { return m_pos; }
+
+  private:
+    qsizetype skipPlain(qsizetype i) const;
+    qsizetype skipString(qsizetype i) const;
+
+    QByteArrayView m_input;
+    qsizetype m_pos;
+};
+
 // basically all .decl files are a sequence of scopes, this is catered to .entities
-QString parse(const QByteArray &data, QList<Scope> &entities);
+QString parse(const QByteArray &data, Tree &tree);
+
+// format a list of entities to be written to a .entities file, only edited entities
+// get formatted again, the rest are copied from their source. Afterwards every written
+// entity has data as its source
+void write(const QList<Entity *> &entities, QByteArray &data, bool parallel = true);
+
+// formats every entity, whether it was edited or not, and leaves their sources alone
+void format(const QList<Entity *> &entities, QByteArray &data, bool parallel = true);
 
-// format a list of entities to be written to a .entities file
-void write(const QList<Entity *> &entities, QByteArray &data);
+// the original QString based formatting, kept to check and benchmark format against
+void writeReference(const QList<Entity *> &entities, QByteArray &data);
 
 }; // namespace decl
 
@@ -0,0 +1,230 @@
+#include "delta.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <climits>
+#include <cstring>
+
+#include "qtutils.h"
+
+#define DELTA_BLOCK_SIZE 32
+#define DELTA_OP_COPY 0
+#define DELTA_OP_LITERAL 1
+#define PATCH_SET_MAGIC 0x56544431 // "VTD1"
+
+namespace delta
+{
+
+namespace
+{
+
+// adler style weak checksum that can slide along one byte at a time
+struct Rolling {
+    quint32 a = 0;
+    quint32 b = 0;
+
+    void init(const uchar *data, const qsizetype length)
+    {
+        a = 0;
+        b = 0;
+        for (qsizetype i = 0; i < length; ++i) {
+            a += data[i];
+            b += static_cast<quint32>(length - i) * data[i];
+        }
+    }
+    void roll(const uchar out, const uchar in, const qsizetype length)
+    {
+        a = a - out + in;
+        b = b - static_cast<quint32>(length) * out + a;
+    }
+    quint32 digest() const { return (a & 0xffff) | (b << 16); }
+};
+
+void putVarint(QByteArray &output, quint64 value)
+{
+    while (value >= 0x80) {
+        output.append(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    output.append(static_cast<char>(value));
+}
+
+bool getVarint(const QByteArrayView input, qsizetype &pos, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= input.size()) {
+            return false;
+        }
+        const auto byte = static_cast<quint8>(input[pos++]);
+        value |= static_cast<quint64>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void putLiteral(QByteArray &output, const uchar *data, const qsizetype length)
+{
+    output.append(static_cast<char>(DELTA_OP_LITERAL));
+    putVarint(output, static_cast<quint64>(length));
+    output.append(reinterpret_cast<const char *>(data), length);
+}
+
+void putCopy(QByteArray &output, const qsizetype offset, const qsizetype length)
+{
+    output.append(static_cast<char>(DELTA_OP_COPY));
+    putVarint(output, static_cast<quint64>(offset));
+    putVarint(output, static_cast<quint64>(length));
+}
+
+} // namespace
+
+QByteArray diff(QByteArrayView original, QByteArrayView modified)
+{
+    const auto o = reinterpret_cast<const uchar *>(original.data());
+    const auto m = reinterpret_cast<const uchar *>(modified.data());
+    const qsizetype blockSize = DELTA_BLOCK_SIZE;
+
+    // checksum of every aligned block of the original, first one wins
+    QHash<quint32, qsizetype> blocks;
+    blocks.reserve(original.size() / blockSize);
+    Rolling rolling;
+    for (qsizetype offset = 0; offset + blockSize <= original.size(); offset += blockSize) {
+        rolling.init(o + offset, blockSize);
+        if (!blocks.contains(rolling.digest())) {
+            blocks.insert(rolling.digest(), offset);
+        }
+    }
+
+    QByteArray output;
+    putVarint(output, static_cast<quint64>(modified.size()));
+    qsizetype literal = 0; // start of the run not covered by a copy yet
+    qsizetype pos = 0;
+    bool primed = false;
+    while (pos + blockSize <= modified.size()) {
+        if (!primed) {
+            rolling.init(m + pos, blockSize);
+            primed = true;
+        }
+        const auto it = blocks.constFind(rolling.digest());
+        if (it != blocks.cend() && std::memcmp(o + *it, m + pos, blockSize) == 0) {
+            // grow the match back into the pending literal and forward as far as it goes
+            qsizetype from = *it;
+            qsizetype to = pos;
+            qsizetype length = blockSize;
+            while (to > literal && from > 0 && o[from - 1] == m[to - 1]) {
+                --from;
+                --to;
+                ++length;
+            }
+            while (from + length < original.size() && to + length < modified.size()
+                   && o[from + length] == m[to + length]) {
+                ++length;
+            }
+            if (to > literal) {
+                putLiteral(output, m + literal, to - literal);
+            }
+            putCopy(output, from, length);
+            pos = to + length;
+            literal = pos;
+            primed = false;
+            continue;
+        }
+        if (pos + blockSize < modified.size()) {
+            rolling.roll(m[pos], m[pos + blockSize], blockSize);
+        }
+        ++pos;
+    }
+    if (modified.size() > literal) {
+        putLiteral(output, m + literal, modified.size() - literal);
+    }
+    return output;
+}
+
+bool apply(QByteArrayView original, QByteArrayView delta, QByteArray &output)
+{
+    qsizetype pos = 0;
+    quint64 size;
+    if (!getVarint(delta, pos, size) || size > static_cast<quint64>(INT_MAX)) {
+        return false;
+    }
+    output.clear();
+    output.reserve(static_cast<qsizetype>(size));
+    while (pos < delta.size()) {
+        const auto op = static_cast<quint8>(delta[pos++]);
+        quint64 offset = 0;
+        quint64 length = 0;
+        if (op == DELTA_OP_COPY) {
+            if (!getVarint(delta, pos, offset) || !getVarint(delta, pos, length)
+                || offset > static_cast<quint64>(original.size())
+                || length > static_cast<quint64>(original.size()) - offset) {
+                return false;
+            }
+            output.append(original.sliced(static_cast<qsizetype>(offset),
+                                          static_cast<qsizetype>(length)));
+        } else if (op == DELTA_OP_LITERAL) {
+            if (!getVarint(delta, pos, length)
+                || length > static_cast<quint64>(delta.size() - pos)) {
+                return false;
+            }
+            output.append(delta.sliced(pos, static_cast<qsizetype>(length)));
+            pos += static_cast<qsizetype>(length);
+        } else {
+            return false;
+        }
+        if (static_cast<quint64>(output.size()) > size) {
+            return false;
+        }
+    }
+    return static_cast<quint64>(output.size()) == size;
+}
+
+QString write(const QString &path, const QList<Patch> &patches)
+{
+    QSaveFile f(path);
+    if (!f.open(QFile::WriteOnly)) {
+        return u"Failed to open patch file: %1"_qs.arg(path);
+    }
+    QDataStream out(&f);
+    out << quint32(PATCH_SET_MAGIC) << qint32(patches.count());
+    for (const auto &p : patches) {
+        out << p.id << p.dst << p.originalHash << p.modifiedHash << p.delta;
+    }
+    if (out.status() != QDataStream::Ok || !f.commit()) {
+        return u"Failed to write patch file: %1"_qs.arg(path);
+    }
+    return {};
+}
+
+QString read(const QString &path, QList<Patch> &patches)
+{
+    QFile f(path);
+    if (!f.open(QFile::ReadOnly)) {
+        return u"Failed to open patch file: %1"_qs.arg(path);
+    }
+    QDataStream in(&f);
+    quint32 magic;
+    qint32 count;
+    in >> magic >> count;
+    if (magic != PATCH_SET_MAGIC || count < 0) {
+        return u"Not a voidtweak patch file: %1"_qs.arg(path);
+    }
+    patches.clear();
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        Patch p;
+        in >> p.id >> p.dst >> p.originalHash >> p.modifiedHash >> p.delta;
+        patches.append(p);
+    }
+    f.close();
+    if (in.status() != QDataStream::Ok) {
+        patches.clear();
+        return u"Patch file is damaged: %1"_qs.arg(path);
+    }
+    return {};
+}
+
+} // namespace delta
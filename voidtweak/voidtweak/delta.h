@@ -0,0 +1,33 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+
+namespace delta
+{
+
+// one modified asset, matched against the install by entry id and the hash of
+// the unmodified asset it was diffed against
+struct Patch {
+    quint32 id = 0;
+    QString dst;
+    quint64 originalHash = 0;
+    quint64 modifiedHash = 0;
+    QByteArray delta;
+};
+
+// rsync style delta, runs of modified that also appear in original become
+// copies and everything else is carried as literal bytes
+QByteArray diff(QByteArrayView original, QByteArrayView modified);
+// rebuild the modified asset, false if the delta does not belong to original
+bool apply(QByteArrayView original, QByteArrayView delta, QByteArray &output);
+
+QString write(const QString &path, const QList<Patch> &patches);
+QString read(const QString &path, QList<Patch> &patches);
+
+} // namespace delta
+
+#endif // DELTA_H
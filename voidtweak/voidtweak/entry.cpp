@@ -3,6 +3,8 @@
 Entry::Entry(const int &container, QObject *parent)
     : QObject(parent)
     , container(container)
+    , hash(0)
+    , integrity(Unchecked)
 {
 }
 
@@ -20,6 +22,8 @@ Entry::Entry(const QPointer<Entry> other, QObject *parent)
     , sizePacked(other->sizePacked)
     , flags1(other->flags1)
     , flags2(other->flags1)
+    , hash(other->hash)
+    , integrity(other->integrity)
 {
 }
 
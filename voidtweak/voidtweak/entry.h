@@ -12,6 +12,14 @@ class Entry : public QObject
     QML_ELEMENT
     QML_UNCREATABLE("Backend only.")
 
+  public:
+    enum Integrity {
+        Unchecked = 0,
+        Intact,
+        Corrupt,
+    };
+    Q_ENUM(Integrity)
+
     CM_PROP(int, container)
     CM_PROP(int, entry)
     CM_PROP(qint64, indexPos)
@@ -24,6 +32,8 @@ class Entry : public QObject
     CM_PROP(quint32, sizePacked)
     CM_PROP(quint16, flags1)
     CM_PROP(quint16, flags2)
+    CM_PROP(quint64, hash) // xxh64 of the packed bytes, 0 until hashed
+    CM_PROP(Integrity, integrity)
 
     Q_PROPERTY(QString srcSuffix READ srcSuffix CONSTANT)
     Q_PROPERTY(QString dstSuffix READ dstSuffix CONSTANT)
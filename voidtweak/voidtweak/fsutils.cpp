@@ -0,0 +1,44 @@
+#include "fsutils.h"
+
+#include <QDir>
+#include <QFile>
+
+#ifdef Q_OS_WINDOWS
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fsutils
+{
+
+bool hardLink(const QString &src, const QString &dst)
+{
+    if (QFile::exists(dst) && !QFile::remove(dst)) {
+        return false;
+    }
+#ifdef Q_OS_WINDOWS
+    const QString nativeSrc = QDir::toNativeSeparators(src);
+    const QString nativeDst = QDir::toNativeSeparators(dst);
+    return CreateHardLinkW(reinterpret_cast<LPCWSTR>(nativeDst.utf16()),
+                           reinterpret_cast<LPCWSTR>(nativeSrc.utf16()), nullptr);
+#else
+    return ::link(QFile::encodeName(src).constData(), QFile::encodeName(dst).constData()) == 0;
+#endif
+}
+
+bool sync(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WINDOWS
+    const auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(file.handle()));
+    return handle != INVALID_HANDLE_VALUE && FlushFileBuffers(handle);
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+} // namespace fsutils
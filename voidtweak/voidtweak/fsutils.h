@@ -0,0 +1,18 @@
+#ifndef FSUTILS_H
+#define FSUTILS_H
+
+#include <QString>
+
+class QFile;
+
+namespace fsutils
+{
+
+// create a hard link at dst pointing to the same data as src, replaces dst
+bool hardLink(const QString &src, const QString &dst);
+// flush everything written to an open file through to the disk
+bool sync(QFile &file);
+
+} // namespace fsutils
+
+#endif // FSUTILS_H
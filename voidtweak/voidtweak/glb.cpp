@@ -0,0 +1,213 @@
+#include "glb.h"
+
+#include <QHash>
+#include <QIODevice>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+#include "qtutils.h"
+#include "vertex.h"
+
+#define GLB_MAGIC 0x46546c67 // "glTF"
+#define GLB_VERSION 2
+#define GLB_CHUNK_JSON 0x4e4f534a // "JSON"
+#define GLB_CHUNK_BIN 0x004e4942  // "BIN\0"
+#define GL_ARRAY_BUFFER 34962
+#define GL_ELEMENT_ARRAY_BUFFER 34963
+#define GL_UNSIGNED_SHORT 5123
+#define GL_FLOAT 5126
+
+namespace glb
+{
+
+namespace
+{
+
+qint64 pad4(const qint64 n) { return (n + 3) & ~qint64(3); }
+
+bool writeU32(QIODevice *output, const quint32 value)
+{
+    const quint32 le = qToLittleEndian(value);
+    return output->write(reinterpret_cast<const char *>(&le), 4) == 4;
+}
+
+} // namespace
+
+QString write(const bwm::Level &level, QIODevice *output)
+{
+    QJsonArray bufferViews;
+    QJsonArray accessors;
+    QJsonArray meshes;
+    QJsonArray nodes;
+    // BIN chunk contents in order, each view is padded out to 4 bytes
+    QList<QByteArrayView> ranges;
+    qint64 binSize = 0;
+    const auto addView = [&](const QByteArrayView data, const int target) {
+        bufferViews.append(QJsonObject{
+            {u"buffer"_qs, 0},
+            {u"byteOffset"_qs, binSize},
+            {u"byteLength"_qs, qint64(data.size())},
+            {u"target"_qs, target},
+        });
+        ranges.append(data);
+        binSize = pad4(binSize + data.size());
+        return bufferViews.count() - 1;
+    };
+
+    // every placed mesh is sliced and decoded once up front, in parallel
+    const QList<vertex::Mesh> sliced = vertex::meshes(level, vertex::placedMeshes(level));
+    const auto floatView = [](const QList<float> &values) {
+        return QByteArrayView(reinterpret_cast<const char *>(values.constData()),
+                              values.count() * qsizetype(sizeof(float)));
+    };
+    // attributes and indexes of each level mesh, shared by every material it's drawn with
+    QList<QJsonObject> attributeSlots(level.meshes.count());
+    QList<qsizetype> indexSlots(level.meshes.count(), -1);
+    for (const auto &mesh : sliced) {
+        if (!mesh.error.isEmpty()) {
+            return mesh.error;
+        }
+        const bwm::PODMesh &m = level.meshes[mesh.index];
+        // validators reject empty buffer views, a mesh without triangles draws nothing
+        // anyway, so whatever places it is left out
+        if (m.vc == 0 || m.vic == 0) {
+            continue;
+        }
+        const bwm::Bounds &b = mesh.bounds;
+        // POSITION accessors have to carry their bounds
+        accessors.append(QJsonObject{
+            {u"bufferView"_qs, addView(mesh.coords, GL_ARRAY_BUFFER)},
+            {u"componentType"_qs, GL_FLOAT},
+            {u"type"_qs, u"VEC3"_qs},
+            {u"count"_qs, qint64(m.vc)},
+            {u"min"_qs, QJsonArray{b.min[0], b.min[1], b.min[2]}},
+            {u"max"_qs, QJsonArray{b.max[0], b.max[1], b.max[2]}},
+        });
+        QJsonObject attributes{{u"POSITION"_qs, accessors.count() - 1}};
+        const vertex::Stream &stream = mesh.stream;
+        if (stream.count == m.vc) {
+            const auto addAttribute = [&](const QString &name, const QList<float> &values,
+                                          const QString &type) {
+                accessors.append(QJsonObject{
+                    {u"bufferView"_qs, addView(floatView(values), GL_ARRAY_BUFFER)},
+                    {u"componentType"_qs, GL_FLOAT},
+                    {u"type"_qs, type},
+                    {u"count"_qs, stream.count},
+                });
+                attributes.insert(name, accessors.count() - 1);
+            };
+            addAttribute(u"NORMAL"_qs, stream.normals, u"VEC3"_qs);
+            addAttribute(u"TEXCOORD_0"_qs, stream.uv1, u"VEC2"_qs);
+            addAttribute(u"TEXCOORD_1"_qs, stream.uv2, u"VEC2"_qs);
+        }
+        accessors.append(QJsonObject{
+            {u"bufferView"_qs, addView(mesh.indexes, GL_ELEMENT_ARRAY_BUFFER)},
+            {u"componentType"_qs, GL_UNSIGNED_SHORT},
+            {u"type"_qs, u"SCALAR"_qs},
+            {u"count"_qs, qint64(m.vic)},
+        });
+        attributeSlots[mesh.index] = attributes;
+        indexSlots[mesh.index] = accessors.count() - 1;
+    }
+
+    // glTF mesh for each pair of level mesh and material that something places
+    QJsonArray materials;
+    QHash<QString, qsizetype> materialSlots;
+    QHash<QPair<quint32, qsizetype>, qsizetype> meshSlots;
+    for (const auto &o : level.objects) {
+        // ignoring LOD objects for now
+        if (o.lod || o.indexStart == o.indexEnd) {
+            continue;
+        }
+        if (o.meshIndex >= level.meshes.count()) {
+            return u"%1 uses missing mesh %2"_qs.arg(bwm::matName(o)).arg(o.meshIndex);
+        }
+        if (indexSlots[o.meshIndex] < 0) {
+            continue;
+        }
+        auto material = materialSlots.constFind(o.materialPath);
+        if (material == materialSlots.cend()) {
+            materials.append(QJsonObject{{u"name"_qs, o.materialPath}});
+            material = materialSlots.insert(o.materialPath, materials.count() - 1);
+        }
+        auto slot = meshSlots.constFind({o.meshIndex, *material});
+        if (slot == meshSlots.cend()) {
+            meshes.append(QJsonObject{
+                {u"name"_qs, u"M%1 %2"_qs.arg(o.meshIndex).arg(bwm::matName(o))},
+                {u"primitives"_qs, QJsonArray{QJsonObject{
+                                       {u"attributes"_qs, attributeSlots[o.meshIndex]},
+                                       {u"indices"_qs, indexSlots[o.meshIndex]},
+                                       {u"material"_qs, *material},
+                                   }}},
+            });
+            slot = meshSlots.insert({o.meshIndex, *material}, meshes.count() - 1);
+        }
+        for (auto i = o.indexStart; i < o.indexEnd; ++i) {
+            const float *matrix = level.matrices[i].values;
+            nodes.append(QJsonObject{
+                {u"name"_qs, u"I%1"_qs.arg(i)},
+                {u"mesh"_qs, *slot},
+                // glTF wants column-major row order, we have row-major, we also swap
+                // the Y and Z rows to get Z+ up instead of Y- up for blender
+                // clang-format off
+                {u"matrix"_qs, QJsonArray{
+                     matrix[ 0], matrix[ 8], matrix[ 4], 0.0,
+                     matrix[ 1], matrix[ 9], matrix[ 5], 0.0,
+                     matrix[ 2], matrix[10], matrix[ 6], 0.0,
+                     matrix[ 3], matrix[11], matrix[ 7], 1.0,
+                }},
+                // clang-format on
+            });
+        }
+    }
+    if (ranges.isEmpty()) {
+        return u"Nothing is placed in this level to export!"_qs;
+    }
+
+    QJsonArray sceneNodes;
+    for (qsizetype n = 0; n < nodes.count(); ++n) {
+        sceneNodes.append(qint64(n));
+    }
+    const QJsonObject gltf{
+        {u"asset"_qs, QJsonObject{{u"version"_qs, u"2.0"_qs}, {u"generator"_qs, u"voidtweak"_qs}}},
+        {u"scene"_qs, 0},
+        {u"scenes"_qs, QJsonArray{QJsonObject{{u"nodes"_qs, sceneNodes}}}},
+        {u"nodes"_qs, nodes},
+        {u"meshes"_qs, meshes},
+        {u"materials"_qs, materials},
+        {u"accessors"_qs, accessors},
+        {u"bufferViews"_qs, bufferViews},
+        {u"buffers"_qs, QJsonArray{QJsonObject{{u"byteLength"_qs, binSize}}}},
+    };
+    QByteArray json = QJsonDocument(gltf).toJson(QJsonDocument::Compact);
+    json.append(pad4(json.size()) - json.size(), ' ');
+
+    // every length is known up front, so the vertex data can go straight out
+    const qint64 total = 12 + 8 + json.size() + 8 + binSize;
+    if (total > 0xffffffffll) {
+        return u"Level is too large for a single GLB file!"_qs;
+    }
+    bool ok = writeU32(output, GLB_MAGIC) && writeU32(output, GLB_VERSION)
+              && writeU32(output, static_cast<quint32>(total))
+              && writeU32(output, static_cast<quint32>(json.size()))
+              && writeU32(output, GLB_CHUNK_JSON) && output->write(json) == json.size()
+              && writeU32(output, static_cast<quint32>(binSize))
+              && writeU32(output, GLB_CHUNK_BIN);
+    const char zeros[4] = {};
+    for (const auto &range : qAsConst(ranges)) {
+        if (!ok) {
+            break;
+        }
+        const qint64 padding = pad4(range.size()) - range.size();
+        ok = output->write(range.data(), range.size()) == range.size()
+             && output->write(zeros, padding) == padding;
+    }
+    if (!ok) {
+        return u"Failed to write GLB: %1"_qs.arg(output->errorString());
+    }
+    return {};
+}
+
+} // namespace glb
@@ -0,0 +1,22 @@
+#ifndef GLB_H
+#define GLB_H
+
+#include <QString>
+
+#include "bwm.h"
+
+class QIODevice;
+
+namespace glb
+{
+
+// stream a level out as binary glTF, one node per placed instance. Only meshes
+// that something places are written, their vertex coords and indexes go
+// straight from the level's views into the BIN chunk, normals and uvs are
+// decoded for just those meshes. Each mesh and material pair gets a glTF mesh,
+// all of them sharing the mesh's buffers. LOD objects are skipped.
+QString write(const bwm::Level &level, QIODevice *output);
+
+} // namespace glb
+
+#endif // GLB_H
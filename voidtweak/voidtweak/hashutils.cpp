@@ -0,0 +1,81 @@
+#include "hashutils.h"
+
+#include <QtEndian>
+
+namespace hashutils
+{
+
+static constexpr quint64 PRIME1 = 0x9E3779B185EBCA87ULL;
+static constexpr quint64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr quint64 PRIME3 = 0x165667B19E3779F9ULL;
+static constexpr quint64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr quint64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline quint64 rotl(const quint64 v, const int r) { return (v << r) | (v >> (64 - r)); }
+
+inline quint64 step(quint64 acc, const quint64 input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline quint64 mergeRound(quint64 acc, const quint64 value)
+{
+    acc ^= step(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+quint64 xxh64(QByteArrayView data, quint64 seed)
+{
+    const char *p = data.data();
+    const char *const end = p + data.size();
+    quint64 h;
+
+    if (data.size() >= 32) {
+        const char *const limit = end - 32;
+        quint64 v1 = seed + PRIME1 + PRIME2;
+        quint64 v2 = seed + PRIME2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - PRIME1;
+        do {
+            v1 = step(v1, qFromLittleEndian<quint64>(p));
+            v2 = step(v2, qFromLittleEndian<quint64>(p + 8));
+            v3 = step(v3, qFromLittleEndian<quint64>(p + 16));
+            v4 = step(v4, qFromLittleEndian<quint64>(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += static_cast<quint64>(data.size());
+    for (; p + 8 <= end; p += 8) {
+        h ^= step(0, qFromLittleEndian<quint64>(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<quint64>(qFromLittleEndian<quint32>(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= static_cast<quint64>(static_cast<uchar>(*p)) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace hashutils
@@ -0,0 +1,15 @@
+#ifndef HASHUTILS_H
+#define HASHUTILS_H
+
+#include <QByteArrayView>
+#include <QtGlobal>
+
+namespace hashutils
+{
+
+// XXH64, stable across runs and platforms so results can be cached on disk
+quint64 xxh64(QByteArrayView data, quint64 seed = 0);
+
+} // namespace hashutils
+
+#endif // HASHUTILS_H
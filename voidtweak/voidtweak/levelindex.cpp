@@ -0,0 +1,118 @@
+#include "levelindex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <iterator>
+
+#include "qtutils.h"
+
+#define LEVEL_INDEX_MAGIC 0x56544c31 // "VTL1"
+
+QDataStream &operator<<(QDataStream &out, const LevelIndex::Use &use)
+{
+    return out << use.level << use.object << use.mesh << use.instances;
+}
+
+QDataStream &operator>>(QDataStream &in, LevelIndex::Use &use)
+{
+    return in >> use.level >> use.object >> use.mesh >> use.instances;
+}
+
+QDataStream &operator<<(QDataStream &out, const LevelIndex::MeshUse &use)
+{
+    return out << use.objects << use.instances;
+}
+
+QDataStream &operator>>(QDataStream &in, LevelIndex::MeshUse &use)
+{
+    return in >> use.objects >> use.instances;
+}
+
+QString LevelIndex::load(const QString &path)
+{
+    clear();
+    QFile f(path);
+    if (!f.exists()) {
+        return {};
+    }
+    if (!f.open(QFile::ReadOnly)) {
+        return u"Failed to open level index: %1"_qs.arg(path);
+    }
+    QDataStream in(&f);
+    quint32 magic;
+    in >> magic;
+    if (magic != LEVEL_INDEX_MAGIC) {
+        // an older layout, it just gets rebuilt
+        return {};
+    }
+    in >> m_stamps >> m_uses >> m_meshes;
+    f.close();
+    if (in.status() != QDataStream::Ok) {
+        clear();
+        return u"Level index is damaged: %1"_qs.arg(path);
+    }
+    return {};
+}
+
+QString LevelIndex::save(const QString &path) const
+{
+    QDir().mkpath(QFileInfo(path).path());
+    QSaveFile f(path);
+    if (!f.open(QFile::WriteOnly)) {
+        return u"Failed to open level index: %1"_qs.arg(path);
+    }
+    QDataStream out(&f);
+    out << quint32(LEVEL_INDEX_MAGIC) << m_stamps << m_uses << m_meshes;
+    if (out.status() != QDataStream::Ok || !f.commit()) {
+        return u"Failed to write level index: %1"_qs.arg(path);
+    }
+    return {};
+}
+
+void LevelIndex::clear()
+{
+    m_stamps.clear();
+    m_uses.clear();
+    m_meshes.clear();
+}
+
+QList<LevelIndex::Placement> LevelIndex::placements(const QList<bwm::PODObject> &objects)
+{
+    QList<Placement> result;
+    result.reserve(objects.count());
+    for (const auto &o : objects) {
+        result.append({o.materialPath, o.meshIndex, o.indexEnd - o.indexStart});
+    }
+    return result;
+}
+
+void LevelIndex::add(const QString &level, const QString &stamp,
+                     const QList<Placement> &objects, const qsizetype meshCount)
+{
+    remove(level);
+    m_stamps.insert(level, stamp);
+    QList<MeshUse> meshes(meshCount, {0, 0});
+    for (qsizetype oi = 0; oi < objects.count(); ++oi) {
+        const auto &o = objects[oi];
+        m_uses[o.material].append({level, static_cast<quint32>(oi), o.mesh, o.instances});
+        if (o.mesh < meshes.count()) {
+            ++meshes[o.mesh].objects;
+            meshes[o.mesh].instances += o.instances;
+        }
+    }
+    m_meshes.insert(level, meshes);
+}
+
+void LevelIndex::remove(const QString &level)
+{
+    if (!m_stamps.remove(level)) {
+        return;
+    }
+    m_meshes.remove(level);
+    for (auto it = m_uses.begin(); it != m_uses.end();) {
+        it->removeIf([&level](const Use &use) { return use.level == level; });
+        it = it->isEmpty() ? m_uses.erase(it) : std::next(it);
+    }
+}
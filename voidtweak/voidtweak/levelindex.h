@@ -0,0 +1,65 @@
+#ifndef LEVELINDEX_H
+#define LEVELINDEX_H
+
+#include <QDataStream>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "bwm.h"
+
+// material and mesh usage across every level, kept on disk so looking something
+// up never needs the levels parsed again
+class LevelIndex
+{
+  public:
+    struct Use {
+        QString level;
+        quint32 object;
+        quint32 mesh;
+        quint32 instances;
+    };
+    // how often one mesh of a level gets placed
+    struct MeshUse {
+        quint32 objects;
+        quint32 instances;
+    };
+    // all add needs of one object, a fraction of the parsed object with its placements
+    struct Placement {
+        QString material;
+        quint32 mesh;
+        quint32 instances;
+    };
+    static QList<Placement> placements(const QList<bwm::PODObject> &objects);
+
+    LevelIndex() = default;
+
+    QString load(const QString &path);
+    QString save(const QString &path) const;
+    void clear();
+    bool isEmpty() const { return m_stamps.isEmpty(); }
+
+    // replaces anything indexed for level before, stamp identifies the exact data
+    void add(const QString &level, const QString &stamp, const QList<Placement> &objects,
+             qsizetype meshCount);
+    void remove(const QString &level);
+    QString stamp(const QString &level) const { return m_stamps.value(level); }
+    QStringList levels() const { return m_stamps.keys(); }
+
+    QStringList materials() const { return m_uses.keys(); }
+    QList<Use> uses(const QString &material) const { return m_uses.value(material); }
+    QList<MeshUse> meshUses(const QString &level) const { return m_meshes.value(level); }
+
+  private:
+    QHash<QString, QString> m_stamps;
+    QHash<QString, QList<Use>> m_uses;      // material path -> every object using it
+    QHash<QString, QList<MeshUse>> m_meshes; // level -> usage of each of its meshes
+};
+
+QDataStream &operator<<(QDataStream &out, const LevelIndex::Use &use);
+QDataStream &operator>>(QDataStream &in, LevelIndex::Use &use);
+QDataStream &operator<<(QDataStream &out, const LevelIndex::MeshUse &use);
+QDataStream &operator>>(QDataStream &in, LevelIndex::MeshUse &use);
+
+#endif // LEVELINDEX_H
@@ -1,4 +1,6 @@
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFontDatabase>
 #include <QGuiApplication>
 #include <QIcon>
@@ -8,6 +10,7 @@
 
 #include "config.h"
 #include "core.h"
+#include "meshexport.h"
 #include "qtutils.h"
 
 bool registerFonts()
@@ -24,9 +27,33 @@ bool registerFonts()
     return success;
 }
 
+// voidtweak --export-meshes <level.bwm> <output.glb|output.obj>, no window is opened
+int exportMeshes(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    QElapsedTimer timer;
+    timer.start();
+    QFile f(args[2]);
+    if (!f.open(QFile::ReadOnly)) {
+        qCritical() << "Failed to open" << args[2];
+        return 1;
+    }
+    const QString error = meshexport::write(f.readAll(), args[3]);
+    if (!error.isEmpty()) {
+        qCritical() << error;
+        return 1;
+    }
+    qInfo() << "Exported" << args[2] << "to" << args[3] << "in" << timer.elapsed() << "ms";
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     qInstallMessageHandler(messageHandler);
+    if (argc == 4 && qstrcmp(argv[1], "--export-meshes") == 0) {
+        return exportMeshes(argc, argv);
+    }
 
     QGuiApplication app(argc, argv);
     app.setApplicationName(APP_NAME);
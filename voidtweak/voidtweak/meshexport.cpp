@@ -0,0 +1,56 @@
+#include "meshexport.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "bwm.h"
+#include "glb.h"
+#include "obj.h"
+#include "qtutils.h"
+
+namespace meshexport
+{
+
+QString write(const QByteArray &data, const QString &path)
+{
+    // the level keeps views into data, it has to outlive the export
+    bwm::Level level;
+    QString error = bwm::parseLevel(data, level);
+    if (!error.isEmpty()) {
+        return error;
+    }
+    const QFileInfo info(path);
+    QSaveFile f(path);
+    if (!f.open(QFile::WriteOnly)) {
+        return u"Failed to open file: %1"_qs.arg(f.fileName());
+    }
+    if (info.suffix().compare(u"obj"_qs, Qt::CaseInsensitive) == 0) {
+        const QString mtlName = info.completeBaseName() + u".mtl"_qs;
+        QSaveFile mtl(info.absoluteDir().absoluteFilePath(mtlName));
+        if (!mtl.open(QFile::WriteOnly)) {
+            return u"Failed to open file: %1"_qs.arg(mtl.fileName());
+        }
+        error = obj::write(level, &f, &mtl, mtlName);
+        if (!error.isEmpty()) {
+            return error;
+        }
+        // the .obj goes first, should the .mtl fail after it the mesh is still there and
+        // only its materials are missing or old
+        if (!f.commit()) {
+            return u"Failed to write file: %1"_qs.arg(f.fileName());
+        }
+        if (!mtl.commit()) {
+            return u"Failed to write file: %1"_qs.arg(mtl.fileName());
+        }
+        return {};
+    }
+    error = glb::write(level, &f);
+    if (!error.isEmpty() || !f.commit()) {
+        f.cancelWriting();
+        return error.isEmpty() ? u"Failed to write file: %1"_qs.arg(f.fileName()) : error;
+    }
+    return {};
+}
+
+} // namespace meshexport
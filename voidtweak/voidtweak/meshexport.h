@@ -0,0 +1,17 @@
+#ifndef MESHEXPORT_H
+#define MESHEXPORT_H
+
+#include <QByteArray>
+#include <QString>
+
+namespace meshexport
+{
+
+// parse a level file and write its placed meshes to path, .obj bakes every instance
+// into an OBJ with an .mtl next to it, anything else is written as instanced GLB.
+// Needs no UI, the same call backs the menu entry and the command line.
+QString write(const QByteArray &data, const QString &path);
+
+} // namespace meshexport
+
+#endif // MESHEXPORT_H
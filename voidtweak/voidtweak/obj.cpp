@@ -0,0 +1,214 @@
+#include "obj.h"
+
+#include <QIODevice>
+#include <QSet>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+#include "qtutils.h"
+#include "vertex.h"
+
+// objects converted at once, bounds how much OBJ text is held before it is written
+#define OBJ_BATCH 64
+
+namespace obj
+{
+
+namespace
+{
+
+struct Job {
+    qsizetype object;
+    const vertex::Mesh *mesh;
+    qint64 firstVertex;    // 1-based, OBJ indexes run across the whole file
+    qint64 firstAttribute; // same for vt and vn, meshes without vertex data add none
+    QByteArray text;
+};
+
+// length is what snprintf wanted to write, past the buffer it got cut short
+template<std::size_t N>
+void append(QByteArray &text, const char (&line)[N], const int length)
+{
+    if (length > 0) {
+        text.append(line, qMin(length, static_cast<int>(N) - 1));
+    }
+}
+
+QByteArray convert(const bwm::Level &level, const Job &job)
+{
+    const bwm::PODObject &o = level.objects[job.object];
+    const vertex::Mesh &mesh = *job.mesh;
+    const vertex::Stream &stream = mesh.stream;
+    const qsizetype vc = mesh.coords.size() / 12;
+    const qsizetype tris = mesh.indexes.size() / 6;
+    const bool attributes = stream.count == vc;
+
+    // the mesh is read once, every instance reuses it
+    QList<float> coords(vc * 3);
+    qFromLittleEndian<float>(mesh.coords.data(), coords.count(), coords.data());
+    QList<quint16> indexes(tris * 3);
+    qFromLittleEndian<quint16>(mesh.indexes.data(), indexes.count(), indexes.data());
+
+    QByteArray text;
+    text.reserve((o.indexEnd - o.indexStart) * (vc * (attributes ? 96 : 40) + tris * 48));
+    text.append("g O" + QByteArray::number(job.object) + '_' + bwm::matName(o).toUtf8() + '\n');
+    text.append("usemtl " + o.materialPath.toUtf8() + '\n');
+    char line[128];
+    qint64 v0 = job.firstVertex;
+    qint64 t0 = job.firstAttribute;
+    for (auto i = o.indexStart; i < o.indexEnd; ++i) {
+        const float *m = level.matrices[i].values;
+        // Y and Z get swapped for Z+ up like the GLB export, that mirrors the mesh so
+        // the winding flips, unless the matrix mirrors it back
+        const float det = m[0] * (m[5] * m[10] - m[6] * m[9])
+                          - m[1] * (m[4] * m[10] - m[6] * m[8])
+                          + m[2] * (m[4] * m[9] - m[5] * m[8]);
+        const bool flip = det > 0.0f;
+        for (qsizetype v = 0; v < vc; ++v) {
+            const float *p = coords.constData() + v * 3;
+            float w[3];
+            for (int row = 0; row < 3; ++row) {
+                const float *r = m + row * 4;
+                w[row] = r[0] * p[0] + r[1] * p[1] + r[2] * p[2] + r[3];
+            }
+            append(text, line,
+                   std::snprintf(line, sizeof(line), "v %.6g %.6g %.6g\n", w[0], w[2], w[1]));
+        }
+        if (attributes) {
+            // normals go through the cofactor of the linear part, which is the inverse
+            // transpose up to a scale that normalizing takes care of
+            const float sign = det < 0.0f ? -1.0f : 1.0f;
+            const float c[9] = {
+                m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+                m[9] * m[2] - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0],
+                m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4],
+            };
+            for (qsizetype v = 0; v < vc; ++v) {
+                const float *n = stream.normals.constData() + v * 3;
+                float w[3];
+                for (int row = 0; row < 3; ++row) {
+                    w[row] = sign * (c[row * 3] * n[0] + c[row * 3 + 1] * n[1]
+                                     + c[row * 3 + 2] * n[2]);
+                }
+                const float length = std::sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+                if (length > 0.0f) {
+                    w[0] /= length;
+                    w[1] /= length;
+                    w[2] /= length;
+                }
+                append(text, line,
+                       std::snprintf(line, sizeof(line), "vn %.4f %.4f %.4f\n", w[0], w[2],
+                                     w[1]));
+            }
+            // uvs have their origin top left like glTF, OBJ wants it bottom left
+            for (qsizetype v = 0; v < vc; ++v) {
+                const float *uv = stream.uv1.constData() + v * 2;
+                append(text, line,
+                       std::snprintf(line, sizeof(line), "vt %.6g %.6g\n", uv[0], 1.0f - uv[1]));
+            }
+        }
+        for (qsizetype t = 0; t < tris; ++t) {
+            qint64 a = indexes[t * 3];
+            qint64 b = indexes[t * 3 + 1];
+            qint64 c = indexes[t * 3 + 2];
+            if (a >= vc || b >= vc || c >= vc) {
+                continue;
+            }
+            if (flip) {
+                std::swap(b, c);
+            }
+            if (attributes) {
+                append(text, line,
+                       std::snprintf(line, sizeof(line),
+                                     "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n", v0 + a,
+                                     t0 + a, t0 + a, v0 + b, t0 + b, t0 + b, v0 + c, t0 + c,
+                                     t0 + c));
+            } else {
+                append(text, line,
+                       std::snprintf(line, sizeof(line), "f %lld %lld %lld\n", v0 + a, v0 + b,
+                                     v0 + c));
+            }
+        }
+        v0 += vc;
+        if (attributes) {
+            t0 += vc;
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+QString write(const bwm::Level &level, QIODevice *output, QIODevice *materials,
+              const QString &materialsName)
+{
+    // every placed mesh is sliced and decoded once up front, in parallel
+    const QList<vertex::Mesh> sliced = vertex::meshes(level, vertex::placedMeshes(level));
+    QList<qsizetype> meshSlots(level.meshes.count(), -1);
+    for (qsizetype i = 0; i < sliced.count(); ++i) {
+        if (!sliced[i].error.isEmpty()) {
+            return sliced[i].error;
+        }
+        meshSlots[sliced[i].index] = i;
+    }
+
+    // each object knows up front where its vertexes start, so they convert in any order
+    QList<Job> jobs;
+    QStringList materialNames;
+    QSet<QString> seen;
+    qint64 vertexes = 0;
+    qint64 attributes = 0;
+    for (qsizetype oi = 0; oi < level.objects.count(); ++oi) {
+        const bwm::PODObject &o = level.objects[oi];
+        // ignoring LOD objects for now
+        if (o.lod || o.indexStart == o.indexEnd) {
+            continue;
+        }
+        if (o.meshIndex >= level.meshes.count()) {
+            return u"%1 uses missing mesh %2"_qs.arg(bwm::matName(o)).arg(o.meshIndex);
+        }
+        const vertex::Mesh &mesh = sliced[meshSlots[o.meshIndex]];
+        jobs.append({oi, &mesh, vertexes + 1, attributes + 1, {}});
+        const qint64 vc = mesh.coords.size() / 12;
+        vertexes += vc * (o.indexEnd - o.indexStart);
+        if (mesh.stream.count == vc) {
+            attributes += vc * (o.indexEnd - o.indexStart);
+        }
+        if (!seen.contains(o.materialPath)) {
+            seen.insert(o.materialPath);
+            materialNames.append(o.materialPath);
+        }
+    }
+    if (jobs.isEmpty()) {
+        return u"Nothing is placed in this level to export!"_qs;
+    }
+
+    const QByteArray header = "# voidtweak\nmtllib " + materialsName.toUtf8() + '\n';
+    bool ok = output->write(header) == header.size();
+    for (qsizetype start = 0; ok && start < jobs.count(); start += OBJ_BATCH) {
+        const auto first = jobs.begin() + start;
+        const auto last = jobs.begin() + qMin(start + OBJ_BATCH, jobs.count());
+        QtConcurrent::blockingMap(first, last,
+                                  [&level](Job &job) { job.text = convert(level, job); });
+        for (auto it = first; ok && it != last; ++it) {
+            ok = output->write(it->text) == it->text.size();
+            it->text = {};
+        }
+    }
+    if (!ok) {
+        return u"Failed to write OBJ: %1"_qs.arg(output->errorString());
+    }
+
+    for (const auto &name : qAsConst(materialNames)) {
+        const QByteArray entry = "newmtl " + name.toUtf8() + "\nKd 0.8 0.8 0.8\n\n";
+        if (materials->write(entry) != entry.size()) {
+            return u"Failed to write materials: %1"_qs.arg(materials->errorString());
+        }
+    }
+    return {};
+}
+
+} // namespace obj
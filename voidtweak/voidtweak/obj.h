@@ -0,0 +1,22 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include <QString>
+
+#include "bwm.h"
+
+class QIODevice;
+
+namespace obj
+{
+
+// bake every placed instance of a level into a Wavefront OBJ, one group per object
+// using its material path as the material name, materials gets a plain entry for
+// each of those. Axes and winding match what glb::write produces. LOD objects are
+// skipped.
+QString write(const bwm::Level &level, QIODevice *output, QIODevice *materials,
+              const QString &materialsName);
+
+} // namespace obj
+
+#endif // OBJ_H
@@ -0,0 +1,153 @@
+#include "overlay.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "delta.h"
+#include "fsutils.h"
+#include "qtutils.h"
+
+#define OVERLAY_MAGIC 0x56544f32    // "VTO2"
+#define OVERLAY_MAGIC_V1 0x56544f31 // "VTO1", one raw blob per key
+#define OVERLAY_CHAIN_LIMIT 16
+
+QString Overlay::load(const QString &dir)
+{
+    QDir().mkpath(dir);
+    m_resourcesPath = QDir(dir).absoluteFilePath(u"overlay.resources"_qs);
+    m_indexPath = QDir(dir).absoluteFilePath(u"overlay.index"_qs);
+    m_chains.clear();
+    QFile f(m_indexPath);
+    if (!f.exists()) {
+        return {};
+    }
+    if (!f.open(QFile::ReadOnly)) {
+        return u"Failed to open overlay index: %1"_qs.arg(m_indexPath);
+    }
+    QDataStream in(&f);
+    quint32 magic;
+    in >> magic;
+    if (magic == OVERLAY_MAGIC_V1) {
+        QHash<QString, Blob> blobs;
+        in >> blobs;
+        for (auto it = blobs.cbegin(); it != blobs.cend(); ++it) {
+            m_chains.insert(it.key(), {it.value()});
+        }
+    } else if (magic == OVERLAY_MAGIC) {
+        in >> m_chains;
+    } else {
+        return u"Overlay index is damaged: %1"_qs.arg(m_indexPath);
+    }
+    f.close();
+    if (in.status() != QDataStream::Ok) {
+        m_chains.clear();
+        return u"Overlay index is damaged: %1"_qs.arg(m_indexPath);
+    }
+    return {};
+}
+
+QString Overlay::read(const QString &key, QByteArray &output) const
+{
+    const QList<Blob> chain = m_chains.value(key);
+    QFile f(m_resourcesPath);
+    if (chain.isEmpty() || !f.open(QFile::ReadOnly)) {
+        return u"Failed to open overlay resources: %1"_qs.arg(m_resourcesPath);
+    }
+    for (qsizetype i = 0; i < chain.count(); ++i) {
+        if (!f.seek(chain[i].first)) {
+            return u"Failed to read overlay resources, asset beyond end of file!"_qs;
+        }
+        const QByteArray blob = f.read(chain[i].second);
+        if (blob.size() != chain[i].second) {
+            return u"Failed to read overlay resources, file too small!"_qs;
+        }
+        if (i == 0) {
+            output = blob;
+            continue;
+        }
+        QByteArray patched;
+        if (!delta::apply(output, blob, patched)) {
+            return u"Overlay patch %1 of %2 does not apply!"_qs.arg(i).arg(key);
+        }
+        output.swap(patched);
+    }
+    return {};
+}
+
+QString Overlay::write(const QString &key, const QByteArray &data)
+{
+    // blobs are only ever appended, so saving an asset again appends a patch against
+    // what the overlay already has and iterating on an edit costs the changed bytes,
+    // a long chain or a patch not much smaller than the asset starts over raw and
+    // leaves the old chain dead until the next deploy or discard empties the overlay
+    const QList<Blob> previous = m_chains.value(key);
+    QList<Blob> chain = previous;
+    QByteArray blob;
+    QByteArray current;
+    if (!chain.isEmpty() && chain.count() < OVERLAY_CHAIN_LIMIT && read(key, current).isEmpty()) {
+        blob = delta::diff(current, data);
+    }
+    current.clear();
+    if (blob.isEmpty() || blob.size() > data.size() / 2) {
+        chain.clear();
+        blob = data;
+    }
+
+    QFile f(m_resourcesPath);
+    if (!f.open(QFile::ReadWrite | QFile::Append)) {
+        return u"Failed to open overlay resources: %1"_qs.arg(m_resourcesPath);
+    }
+    const qint64 pos = f.size();
+    if (f.write(blob) != blob.size() || !fsutils::sync(f)) {
+        f.close();
+        f.resize(pos);
+        return u"Failed to write overlay resources: %1"_qs.arg(m_resourcesPath);
+    }
+    f.close();
+    chain.append({pos, blob.size()});
+    m_chains.insert(key, chain);
+    const QString error = saveIndex();
+    if (!error.isEmpty()) {
+        if (previous.isEmpty()) {
+            m_chains.remove(key);
+        } else {
+            m_chains.insert(key, previous);
+        }
+    }
+    return error;
+}
+
+QString Overlay::remove(const QString &key)
+{
+    if (!m_chains.remove(key)) {
+        return {};
+    }
+    return m_chains.isEmpty() ? clear() : saveIndex();
+}
+
+QString Overlay::clear()
+{
+    m_chains.clear();
+    if ((QFile::exists(m_indexPath) && !QFile::remove(m_indexPath))
+        || (QFile::exists(m_resourcesPath) && !QFile::remove(m_resourcesPath))) {
+        return u"Failed to remove overlay files in: %1"_qs.arg(QFileInfo(m_indexPath).path());
+    }
+    return {};
+}
+
+QString Overlay::saveIndex() const
+{
+    QSaveFile f(m_indexPath);
+    if (!f.open(QFile::WriteOnly)) {
+        return u"Failed to open overlay index: %1"_qs.arg(m_indexPath);
+    }
+    QDataStream out(&f);
+    out << quint32(OVERLAY_MAGIC) << m_chains;
+    if (out.status() != QDataStream::Ok || !f.commit()) {
+        return u"Failed to write overlay index: %1"_qs.arg(m_indexPath);
+    }
+    return {};
+}
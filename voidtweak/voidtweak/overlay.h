@@ -0,0 +1,42 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+// edited assets kept in a resources/index pair of our own instead of the game
+// files, each save only appends what changed since the last one and a deploy
+// later writes them all into the game files in one go
+class Overlay
+{
+  public:
+    Overlay() = default;
+
+    // dir is where overlay.resources and overlay.index live
+    QString load(const QString &dir);
+    bool contains(const QString &key) const { return m_chains.contains(key); }
+    QStringList keys() const { return m_chains.keys(); }
+    int count() const { return m_chains.count(); }
+
+    QString read(const QString &key, QByteArray &output) const;
+    QString write(const QString &key, const QByteArray &data);
+    QString remove(const QString &key);
+    QString clear();
+
+  private:
+    // position and size of a blob in the overlay resources
+    using Blob = QPair<qint64, qint64>;
+
+    QString saveIndex() const;
+
+    QString m_resourcesPath;
+    QString m_indexPath;
+    // key -> the raw asset as first saved, then a delta::diff patch per later save
+    QHash<QString, QList<Blob>> m_chains;
+};
+
+#endif // OVERLAY_H
@@ -68,9 +68,9 @@ Rectangle {
         anchors.margins: 10
 
         Label {
-            text: `<b>ID:</b> ${entry.id}`
+            text: entry.integrity === Entry.Corrupt ? `<b>CORRUPT</b> ID: ${entry.id}` : `<b>ID:</b> ${entry.id}`
             horizontalAlignment: Label.AlignRight
-            color: "#DDD"
+            color: entry.integrity === Entry.Corrupt ? "orange" : "#DDD"
         }
         Label {
             text: `<b>Size:</b> ${formatBytes(entry.size)}`
@@ -98,10 +98,21 @@ Item {
         }
 
         Button {
+            id: exportButton
             text: "Export All"
             enabled: !core.busy && !!core.entryCount
 
-            onClicked: folderDialog.open()
+            onClicked: exportMenu.popup(exportButton, 0, exportButton.height)
+
+            Layout.fillHeight: true
+        }
+
+        Button {
+            id: toolsButton
+            text: "Tools"
+            enabled: !core.busy && !!core.entryCount
+
+            onClicked: toolsMenu.popup(toolsButton, 0, toolsButton.height)
 
             Layout.fillHeight: true
         }
@@ -167,6 +178,119 @@ Item {
         anchors.margins: 5
     }
 
+    Label {
+        id: reportLabel
+        text: core.report
+        visible: !core.error && !!core.report
+        color: "#DDD"
+        anchors.left: parent.left
+        anchors.bottom: parent.bottom
+        anchors.margins: 5
+    }
+
+    Menu {
+        id: exportMenu
+
+        MenuItem {
+            text: "To Folder"
+            onTriggered: {
+                folderDialog.deduplicate = false
+                folderDialog.open()
+            }
+        }
+        MenuItem {
+            text: "To Folder (Deduplicated)"
+            onTriggered: {
+                folderDialog.deduplicate = true
+                folderDialog.open()
+            }
+        }
+        MenuItem {
+            text: "To Archive (tar)"
+            onTriggered: {
+                archiveDialog.withIndex = false
+                archiveDialog.open()
+            }
+        }
+        MenuItem {
+            text: "To Archive (tar + index)"
+            onTriggered: {
+                archiveDialog.withIndex = true
+                archiveDialog.open()
+            }
+        }
+    }
+
+    Menu {
+        id: toolsMenu
+
+        MenuItem {
+            text: "Find Duplicates"
+            onTriggered: core.findDuplicates()
+        }
+        MenuItem {
+            text: "Verify All"
+            onTriggered: core.verifyAll()
+        }
+        MenuItem {
+            text: "Compact Resources"
+            onTriggered: core.compactResources()
+        }
+        MenuItem {
+            text: "Benchmark BWM Parsers"
+            onTriggered: core.benchmarkBwm()
+        }
+        MenuItem {
+            text: "Benchmark Entity Writers"
+            onTriggered: core.benchmarkEntities()
+        }
+        MenuSeparator {}
+        MenuItem {
+            text: "Save To Overlay"
+            checkable: true
+            checked: core.useOverlay
+            onToggled: core.useOverlay = checked
+        }
+        MenuItem {
+            text: `Deploy Overlay (${core.overlayCount})`
+            enabled: !!core.overlayCount
+            onTriggered: core.deployOverlay()
+        }
+        MenuItem {
+            text: "Discard Overlay"
+            enabled: !!core.overlayCount
+            onTriggered: core.discardOverlay()
+        }
+        MenuSeparator {}
+        MenuItem {
+            // patches are diffs of overlay assets against the game files, saves made
+            // with the overlay off leave nothing to diff against
+            text: enabled ? "Export Patches" : "Export Patches (Save To Overlay First)"
+            enabled: core.useOverlay && !!core.overlayCount
+            onTriggered: {
+                patchDialog.fileMode = FileDialog.SaveFile
+                patchDialog.open()
+            }
+        }
+        MenuItem {
+            text: "Import Patches"
+            onTriggered: {
+                patchDialog.fileMode = FileDialog.OpenFile
+                patchDialog.open()
+            }
+        }
+        MenuSeparator {}
+        MenuItem {
+            text: "Index Levels"
+            onTriggered: core.indexLevels()
+        }
+        MenuItem {
+            text: `Material Usage (${core.indexedLevels} levels)`
+            enabled: !!core.indexedLevels
+            onTriggered: materialDialog.open()
+        }
+    }
+
     Menu {
         id: contextMenu
 
@@ -189,6 +313,13 @@ Item {
                 fileDialog.open()
             }
         }
+        MenuItem {
+            text: "Import From Archive"
+            onTriggered: {
+                restoreDialog.entry = contextMenu.entry
+                restoreDialog.open()
+            }
+        }
         MenuItem {
             text: "Load Entities"
             visible: contextMenu.entry
@@ -202,6 +333,17 @@ Item {
             height: visible ? undefined : 0
             onTriggered: core.loadBwm(contextMenu.entry)
         }
+        MenuItem {
+            text: "Export Meshes"
+            visible: contextMenu.entry && contextMenu.entry.dstSuffix === "bwm"
+            height: visible ? undefined : 0
+            onTriggered: {
+                meshDialog.entry = contextMenu.entry
+                meshDialog.selectedFile = contextMenu.entry.dstFileName.replace(
+                            /\.bwm$/, ".glb")
+                meshDialog.open()
+            }
+        }
     }
 
     FileDialog {
@@ -232,10 +374,122 @@ Item {
         id: folderDialog
         currentFolder: settings.lastFolder
 
-        onAccepted: core.exportAllEntries(folderDialog.selectedFolder)
+        property bool deduplicate: false
+
+        onAccepted: {
+            if (folderDialog.deduplicate) {
+                core.exportUniqueEntries(folderDialog.selectedFolder)
+            } else {
+                core.exportAllEntries(folderDialog.selectedFolder)
+            }
+        }
         onCurrentFolderChanged: settings.lastFolder = currentFolder
     }
 
+    FileDialog {
+        id: archiveDialog
+        currentFolder: settings.lastFolder
+        fileMode: FileDialog.SaveFile
+        nameFilters: ["Tar archives (*.tar)"]
+        selectedFile: "voidtweak-export.tar"
+
+        property bool withIndex: false
+
+        onAccepted: core.exportArchive(archiveDialog.selectedFile,
+                                       archiveDialog.withIndex)
+    }
+
+    FileDialog {
+        id: restoreDialog
+        currentFolder: settings.lastFolder
+        fileMode: FileDialog.OpenFile
+        nameFilters: ["Tar archives (*.tar)"]
+
+        property Entry entry
+
+        onAccepted: core.importFromArchive(restoreDialog.entry,
+                                           restoreDialog.selectedFile)
+    }
+
+    FileDialog {
+        id: meshDialog
+        currentFolder: settings.lastFolder
+        fileMode: FileDialog.SaveFile
+        nameFilters: ["Binary glTF (*.glb)", "Wavefront OBJ (*.obj)"]
+
+        property Entry entry
+
+        onAccepted: core.exportMesh(meshDialog.entry, meshDialog.selectedFile)
+    }
+
+    FileDialog {
+        id: patchDialog
+        currentFolder: settings.lastFolder
+        nameFilters: ["VoidTweak patches (*.vtpatch)"]
+        selectedFile: "voidtweak-patches.vtpatch"
+
+        onAccepted: {
+            if (patchDialog.fileMode === FileDialog.SaveFile) {
+                core.exportPatches(patchDialog.selectedFile)
+            } else {
+                core.importPatches(patchDialog.selectedFile)
+            }
+        }
+    }
+
+    Dialog {
+        id: materialDialog
+        title: "Material Usage"
+        standardButtons: Dialog.Close
+        modal: true
+        x: (parent.width - width) / 2
+        y: (parent.height - height) / 2
+        width: parent.width * 0.8
+        height: parent.height * 0.8
+
+        property var uses: []
+
+        TextField {
+            id: materialInput
+            placeholderText: "Find material..."
+            selectByMouse: true
+            selectionColor: "orange"
+            anchors.left: parent.left
+            anchors.right: parent.right
+            anchors.top: parent.top
+
+            onAccepted: {
+                let uses = []
+                for (const material of core.findMaterials(text)) {
+                    uses = uses.concat(core.materialUses(material).map(
+                                           use => Object.assign({
+                                                                    "material": material
+                                                                }, use)))
+                }
+                materialDialog.uses = uses
+            }
+        }
+
+        ListView {
+            model: materialDialog.uses
+            clip: true
+            boundsBehavior: ListView.StopAtBounds
+            anchors.left: parent.left
+            anchors.right: parent.right
+            anchors.top: materialInput.bottom
+            anchors.bottom: parent.bottom
+            anchors.topMargin: 5
+
+            delegate: Label {
+                width: ListView.view.width
+                text: `${modelData.material} in ${modelData.level}, object ${modelData.object}, `
+                      + `mesh ${modelData.mesh}, ${modelData.instances} instances`
+                elide: Label.ElideMiddle
+                color: "#DDD"
+            }
+        }
+    }
+
     Settings {
         id: settings
 
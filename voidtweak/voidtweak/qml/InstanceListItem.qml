@@ -9,8 +9,8 @@ Rectangle {
     implicitHeight: gridLayout.height + 20
     color: index % 2 ? "#555" : "#444"
 
-    property Instance inst
-    property Matrix mat
+    // a row of core.instances, assigning to its roles edits the level
+    property var inst
 
     function formatAddr(pos) {
         return pos.toString(16).padStart(8, '0')
@@ -30,18 +30,28 @@ Rectangle {
             Layout.fillWidth: true
             Label {
                 text: `<b>Instance Offset:</b> ${formatAddr(
-                          control.inst.offset)}`
+                          control.inst.instanceOffset)}`
                 color: "#DDD"
                 Layout.fillWidth: true
             }
             Label {
-                text: `<b>Matrix Offset:</b> ${formatAddr(control.mat.offset)}`
+                text: `<b>Matrix Offset:</b> ${formatAddr(
+                          control.inst.matrixOffset)}`
                 horizontalAlignment: Label.AlignRight
                 color: "#DDD"
                 Layout.fillWidth: true
             }
         }
 
+        Label {
+            text: `<b>Dark Vision Layer:</b> ${control.inst.darkVisionLayer || "none"}, `
+                  + `<b>Groups:</b> ${control.inst.groupCount}`
+            elide: Label.ElideRight
+            color: "#DDD"
+            Layout.fillWidth: true
+            Layout.columnSpan: 3
+        }
+
         Label {
             text: "<b>Translation:</b>"
             elide: Label.ElideRight
@@ -50,19 +60,19 @@ Rectangle {
             Layout.columnSpan: 3
         }
         TextField {
-            text: control.mat.x4
+            text: control.inst.x4
             Layout.fillWidth: true
-            onEditingFinished: control.mat.x4 = text
+            onEditingFinished: control.inst.x4 = text
         }
         TextField {
-            text: control.mat.y4
+            text: control.inst.y4
             Layout.fillWidth: true
-            onEditingFinished: control.mat.y4 = text
+            onEditingFinished: control.inst.y4 = text
         }
         TextField {
-            text: control.mat.z4
+            text: control.inst.z4
             Layout.fillWidth: true
-            onEditingFinished: control.mat.z4 = text
+            onEditingFinished: control.inst.z4 = text
         }
 
         Label {
@@ -8,7 +8,8 @@ Rectangle {
     implicitHeight: 80
     color: index % 2 ? "#555" : "#444"
 
-    property Object obj
+    // a row of core.objects, either the delegate model or a get() copy
+    property var obj
 
     function formatAddr(pos) {
         return pos.toString(16).padStart(8, '0')
@@ -55,12 +56,7 @@ Rectangle {
             color: "#DDD"
         }
         Label {
-            text: `<b>Matrices:</b> ${obj.matrices.length}`
-            horizontalAlignment: Label.AlignRight
-            color: "#DDD"
-        }
-        Label {
-            text: `<b>Instances:</b> ${obj.instances.length}`
+            text: `<b>Instances:</b> ${obj.instanceCount}`
             horizontalAlignment: Label.AlignRight
             color: "#DDD"
         }
@@ -6,8 +6,8 @@ import voidtweak
 Item {
     id: outerPage
 
-    property string filter
-    property Object obj
+    // plain copy of the selected core.objects row
+    property var obj
 
     function formatAddr(pos) {
         return pos.toString(16).padStart(8, '0')
@@ -26,9 +26,7 @@ Item {
 
             ListView {
                 id: objectList
-                model: !outerPage.filter ? core.objects : core.objects.filter(
-                                               o => o.materialPath.includes(
-                                                   outerPage.filter))
+                model: core.objects
                 enabled: !core.busy
                 interactive: !contextMenu.visible
                 boundsBehavior: ListView.StopAtBounds
@@ -40,12 +38,12 @@ Item {
 
                 delegate: ObjectListItem {
                     width: ListView.view.width
-                    obj: modelData
+                    obj: model
 
                     MouseArea {
                         anchors.fill: parent
 
-                        onClicked: outerPage.obj = modelData
+                        onClicked: outerPage.obj = core.objects.get(index)
                     }
                 }
             }
@@ -64,6 +62,7 @@ Item {
             TextField {
                 id: filterInput
                 placeholderText: "Filter objects..."
+                text: core.objects.filter
                 selectByMouse: true
                 selectionColor: "orange"
                 anchors.left: clearButton.right
@@ -72,7 +71,7 @@ Item {
                 anchors.margins: 5
 
                 onAccepted: {
-                    outerPage.filter = text
+                    core.objects.filter = text
                 }
             }
 
@@ -103,12 +102,15 @@ Item {
         Item {
             id: page
 
+            Component.onCompleted: core.instances.object = outerPage.obj.objectIndex
+            Component.onDestruction: core.instances.object = -1
+
             ListView {
                 id: objectList
-                model: outerPage.obj.instances
+                model: core.instances
                 enabled: !core.busy
                 boundsBehavior: ListView.StopAtBounds
-                anchors.top: clearButton.bottom
+                anchors.top: transformRow.bottom
                 anchors.left: parent.left
                 anchors.right: parent.right
                 anchors.bottom: parent.bottom
@@ -116,8 +118,7 @@ Item {
 
                 delegate: InstanceListItem {
                     width: ListView.view.width
-                    inst: modelData
-                    mat: outerPage.obj.matrices[index]
+                    inst: model
                 }
             }
 
@@ -150,7 +151,175 @@ Item {
 
                 onClicked: {
                     forceActiveFocus()
-                    core.saveObject(outerPage.obj)
+                    core.saveObject(outerPage.obj.objectIndex)
+                }
+            }
+
+            RowLayout {
+                id: pickRow
+                enabled: !core.busy
+                anchors.left: parent.left
+                anchors.right: parent.right
+                anchors.top: clearButton.bottom
+                anchors.margins: 5
+
+                // instances the edits below apply to instead of the object's own, may
+                // belong to any object of the level
+                property var picked: null
+
+                function point() {
+                    return Qt.vector3d(Number(pointX.text), Number(pointY.text),
+                                       Number(pointZ.text))
+                }
+
+                function pick() {
+                    const p = point()
+                    const v = Number(pickValue.text)
+                    const e = Qt.vector3d(v, v, v)
+                    switch (pickMode.currentIndex) {
+                    case 0:
+                        return core.instancesInBox(p.minus(e), p.plus(e))
+                    case 1:
+                        return core.instancesInSphere(p, v)
+                    case 2:
+                        return core.instancesOnRay(p, Qt.vector3d(0, 0, -1))
+                    default:
+                        return core.nearestInstances(p, v)
+                    }
+                }
+
+                ComboBox {
+                    id: pickMode
+                    model: ["In Box", "In Sphere", "Below", "Nearest"]
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Pick instances around the point, by box half size, "
+                                  + "sphere radius, straight down or nearest count"
+                }
+
+                TextField {
+                    id: pointX
+                    placeholderText: "Point X"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                TextField {
+                    id: pointY
+                    placeholderText: "Point Y"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                TextField {
+                    id: pointZ
+                    placeholderText: "Point Z"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                TextField {
+                    id: pickValue
+                    placeholderText: "Size"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                Button {
+                    text: "Pick"
+
+                    onClicked: pickRow.picked = pickRow.pick()
+                }
+
+                Button {
+                    text: pickRow.picked ? `${pickRow.picked.length} Picked` : "Object"
+                    enabled: !!pickRow.picked
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Go back to editing the instances of this object"
+
+                    onClicked: pickRow.picked = null
+                }
+            }
+
+            RowLayout {
+                id: transformRow
+                enabled: !core.busy
+                anchors.left: parent.left
+                anchors.right: parent.right
+                anchors.top: pickRow.bottom
+                anchors.margins: 5
+
+                function instances() {
+                    if (pickRow.picked) {
+                        return pickRow.picked
+                    }
+                    const o = outerPage.obj
+                    return Array.from({
+                                          "length": o.indexEnd - o.indexStart
+                                      }, (_, i) => o.indexStart + i)
+                }
+
+                function offset() {
+                    return Qt.vector3d(Number(offsetX.text), Number(offsetY.text),
+                                       Number(offsetZ.text))
+                }
+
+                TextField {
+                    id: offsetX
+                    placeholderText: "X"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                TextField {
+                    id: offsetY
+                    placeholderText: "Y"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                TextField {
+                    id: offsetZ
+                    placeholderText: "Z"
+                    selectByMouse: true
+                    Layout.fillWidth: true
+                }
+
+                Button {
+                    text: "Move"
+
+                    onClicked: core.translateInstances(transformRow.instances(),
+                                                       transformRow.offset())
+                }
+
+                Button {
+                    text: "Rotate"
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Rotate by X degrees around the Z axis"
+
+                    onClicked: core.rotateInstances(transformRow.instances(),
+                                                    Qt.vector3d(0, 0, 1),
+                                                    Number(offsetX.text))
+                }
+
+                Button {
+                    text: "Scale"
+                    ToolTip.visible: hovered
+                    ToolTip.text: "Scale by X around the middle of the instances"
+
+                    onClicked: core.scaleInstances(transformRow.instances(),
+                                                   Number(offsetX.text))
+                }
+
+                Button {
+                    text: "Undo"
+
+                    onClicked: core.undoTransform()
+                }
+
+                Button {
+                    text: "Redo"
+
+                    onClicked: core.redoTransform()
                 }
             }
         }
@@ -15,7 +15,7 @@ ApplicationWindow {
         source: {
             if (!!core.entities.length) {
                 return "EntitiesListPage.qml"  // .entities files edit page
-            } else if (!!core.objects.length) {
+            } else if (!!core.objects.total) {
                 return "ObjectsListPage.qml"  // 3d "objects" edit page
             } else {
                 return "EntrySearchPage.qml" // main page resource file "entries"
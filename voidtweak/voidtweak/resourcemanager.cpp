@@ -1,17 +1,128 @@
 #include "resourcemanager.h"
 
+#include <QBuffer>
 #include <QDataStream>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <atomic>
+#include <cstring>
 
 #include "container.h"
+#include "delta.h"
 #include "entry.h"
+#include "fsutils.h"
+#include "hashutils.h"
+#include "meshexport.h"
+#include "resourcemap.h"
 #include "steam.h"
+#include "tar.h"
+#include "transaction.h"
+#include "vertex.h"
 #include "zutils.h"
 
+#define HASH_CACHE_MAGIC 0x56544831 // "VTH1"
+#define INDEX_ENTRY_ID_SIZE 4
+#define COMPACT_BATCH_BYTES (256 * 1024 * 1024)
+#define COMPACT_BACKUP_SUFFIX u".vtbak"_qs
+#define LEVEL_INDEX_BUDGET (512 * 1024 * 1024)
+
 ResourceManager::ResourceManager(QObject *parent)
     : QObject{parent}
+    , m_hashed(false)
+    , m_useOverlay(false)
+    , m_overlay()
+    , m_levelIndex()
+    , m_levelKey()
+    , m_level()
+{
+}
+
+// index entries are variable length, step over the id and the three strings to
+// find where the resource position and sizes of the entry at indexPos start
+static qint64 indexFieldsPos(QIODevice *index, const qint64 indexPos)
+{
+    if (!index->seek(indexPos + INDEX_ENTRY_ID_SIZE)) {
+        return -1;
+    }
+    for (int i = 0; i < 3; ++i) {
+        quint32 strLen;
+        if (index->read(reinterpret_cast<char *>(&strLen), sizeof(strLen)) != sizeof(strLen)) {
+            return -1;
+        }
+        if (!index->seek(index->pos() + qFromLittleEndian(strLen))) {
+            return -1;
+        }
+    }
+    return index->pos();
+}
+
+// dead ranges are remembered per resource file, by full path since every container
+// has resource files with the same names. Escaped so the path stays a single key
+static QString orphanKey(const QString &resourcePath)
+{
+    return u"orphans/%1"_qs.arg(QString::fromLatin1(resourcePath.toUtf8().toPercentEncoding()));
+}
+
+static QString hashCachePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/hashes.bin"_qs;
+}
+
+static QString levelIndexPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/levels.bin"_qs;
+}
+
+static QString journalPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + u"/journal.bin"_qs;
+}
+
+static QString overlayDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + u"/overlay"_qs;
+}
+
+// overlay assets are tied to an entry by its index file and where it sits in it,
+// neither changes when we relink or compact
+static QString overlayKey(const Container *c, const Entry *e)
+{
+    return u"%1@%2"_qs.arg(c->path).arg(e->indexPos);
+}
+
+// the asset as the game files have it, ignoring the overlay
+static bool unpack(const ResourceMap &map, const Container *c, const Entry *e, QByteArray &output)
+{
+    const QByteArrayView packed = map.packed(c, e);
+    if (packed.isNull()) {
+        return false;
+    }
+    if (e->size == e->sizePacked) {
+        output = packed.toByteArray();
+        return true;
+    }
+    return zutils::inflt(packed, output, e->size) && output.size() == e->size;
+}
+
+// identifies the exact state of a container's files on disk, if any of them
+// change then the cached hashes for that container are thrown away
+static QString containerStamp(const Container *c)
 {
+    QStringList parts;
+    const QFileInfo index(c->indexPath());
+    parts << u"%1:%2"_qs.arg(index.size()).arg(index.lastModified().toMSecsSinceEpoch());
+    for (int ri = 0; ri < c->resources.count(); ++ri) {
+        const QFileInfo rsc(c->resourcePath(static_cast<quint16>(ri << 2)));
+        parts << u"%1:%2"_qs.arg(rsc.size()).arg(rsc.lastModified().toMSecsSinceEpoch());
+    }
+    return parts.join(';');
 }
 
 void ResourceManager::loadIndexes()
@@ -19,6 +130,20 @@ void ResourceManager::loadIndexes()
     emit statusChanged(true, {});
     qDebug() << "Started loading...";
     qDeleteAllLater(m_containers);
+    m_hashed = false;
+    forgetLevel();
+    // a save that was interrupted part way leaves its journal behind
+    const QString error = Transaction::recover(journalPath());
+    if (!error.isEmpty()) {
+        emit statusChanged(false, u"Failed to roll back interrupted save: %1"_qs.arg(error));
+        return;
+    }
+    const QString overlayError = m_overlay.load(overlayDir());
+    emit overlayChanged(m_overlay.count());
+    if (!overlayError.isEmpty()) {
+        emit statusChanged(false, overlayError);
+        return;
+    }
     if (!loadMasterIndex())
         return;
     if (!loadChildIndexes())
@@ -28,22 +153,12 @@ void ResourceManager::loadIndexes()
         entryCount += c->entries.count();
     }
     qDebug() << "Finished loading...";
-    // const QStringList names = {
-    //     u"curator_p_lowchaos.bwm"_qs,        u"curator_p_highchaos.bwm"_qs,
-    //     u"madinv_streets_p_lowchaos.bwm"_qs, u"madinv_streets_p_highchaos.bwm"_qs,
-    //     u"institute_p_lowchaos.bwm"_qs,      u"institute_p_highchaos.bwm"_qs,
-    //     u"eotw_p_lowchaos.bwm"_qs,           u"eotw_p_highchaos.bwm"_qs,
-    //     u"dunwall_escape_streets_p.bwm"_qs,
-    // };
-    // for (const auto c : m_containers) {
-    //     for (const auto e : c->entries) {
-    //         if (e->dstSuffix() == u"bwm"_qs /*&& names.contains(e->dstFileName())*/) {
-    //             qInfo() << "Loading" << e->dstFileName();
-    //             loadBwm(e);
-    //         }
-    //     }
-    // }
-    // qInfo() << "Done loading bwm objects...";
+    // whatever was indexed last time is good for lookups until the next indexLevels
+    const QString levelError = m_levelIndex.load(levelIndexPath());
+    if (!levelError.isEmpty()) {
+        qWarning() << levelError;
+    }
+    emit levelIndexChanged(m_levelIndex);
     emit indexesLoaded(m_containers.count(), entryCount);
     emit statusChanged(false, {});
 }
@@ -224,7 +339,9 @@ void ResourceManager::extractEntry(const QPointer<Entry> ref)
 void ResourceManager::insertEntry(const QPointer<Entry> ref, QByteArray data)
 {
     emit statusChanged(true, {});
-    insert(ref, data);
+    if (!save(ref, data)) {
+        return;
+    }
     emit statusChanged(false, {});
 }
 
@@ -256,7 +373,31 @@ void ResourceManager::importEntry(const QPointer<Entry> ref, QUrl path)
         emit statusChanged(false, u"Failed to open file: %1"_qs.arg(f.fileName()));
         return;
     }
-    insert(ref, data);
+    if (!save(ref, data)) {
+        return;
+    }
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::importFromArchive(const QPointer<Entry> ref, QUrl path)
+{
+    emit statusChanged(true, {});
+    if (!ref) {
+        emit statusChanged(false, u"Invalid entry reference!"_qs);
+        return;
+    }
+    // archives are written with entry paths as member names, so an asset can be put
+    // back from one without unpacking the rest
+    QByteArray data;
+    const QString error = tar::read(path.toLocalFile(), ref->dst, data);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    if (!save(ref, data)) {
+        return;
+    }
+    emit report(u"Restored %1 from %2"_qs.arg(ref->dst, path.toLocalFile()));
     emit statusChanged(false, {});
 }
 
@@ -266,10 +407,10 @@ void ResourceManager::loadEntities(const QPointer<Entry> ref)
     QByteArray data;
     if (!extract(ref, data))
         return;
-    QList<decl::Scope> entities;
-    QString error = decl::parse(data, entities);
+    decl::Tree tree;
+    QString error = decl::parse(data, tree);
     if (error.isEmpty()) {
-        emit entitiesLoaded(ref, entities);
+        emit entitiesLoaded(ref, tree);
         emit statusChanged(false, {});
     } else {
         emit statusChanged(false, error);
@@ -317,56 +458,863 @@ void ResourceManager::exportAllEntries(QUrl path)
     emit statusChanged(false, {});
 }
 
+void ResourceManager::exportUniqueEntries(QUrl path)
+{
+    emit statusChanged(true, {});
+    QDir dir(path.toLocalFile());
+    if (!dir.mkpath(dir.absolutePath())) {
+        emit statusChanged(false, u"Failed to create directory: %1"_qs.arg(dir.absolutePath()));
+        return;
+    }
+    if (!hashEntries()) {
+        return;
+    }
+    qDebug() << "Starting deduplicated export...";
+    // NOTE: duplicates are hard links, editing one exported file edits them all
+    QHash<QPair<quint64, quint32>, QString> exported;
+    QByteArray buffer;
+    qint64 bytesWritten = 0;
+    int linked = 0;
+    for (const auto e : finalEntries()) {
+        const QString dstDir = dir.absoluteFilePath(e->dstDir());
+        const QString dst = dir.absoluteFilePath(e->dst);
+        if (!dir.mkpath(dstDir)) {
+            emit statusChanged(false, u"Failed to create directory: %1"_qs.arg(dstDir));
+            return;
+        }
+        const auto key = qMakePair(e->hash, e->size);
+        const QString original = exported.value(key);
+        if (!original.isEmpty()) {
+            if (!fsutils::hardLink(original, dst) && !QFile::copy(original, dst)) {
+                emit statusChanged(false, u"Failed to link file: %1"_qs.arg(dst));
+                return;
+            }
+            ++linked;
+            continue;
+        }
+        buffer.resize(0);
+        if (!extract(e, buffer)) {
+            return;
+        }
+        // never write through an old hard link from a previous export
+        QFile::remove(dst);
+        QFile f(dst);
+        if (!f.open(QFile::WriteOnly)) {
+            emit statusChanged(false, u"Failed to open file: %1"_qs.arg(dst));
+            return;
+        }
+        const auto written = f.write(buffer);
+        f.close();
+        if (written != buffer.size()) {
+            emit statusChanged(false, u"Failed to write file: %1"_qs.arg(dst));
+            return;
+        }
+        bytesWritten += written;
+        exported.insert(key, dst);
+    }
+    qDebug() << "Exported" << bytesWritten / 1024 / 1024 << "mb of data and linked" << linked
+             << "duplicates!";
+    emit report(u"Exported %1 unique assets, linked %2 duplicates"_qs.arg(exported.count())
+                    .arg(linked));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::exportArchive(QUrl path, bool withIndex)
+{
+    emit statusChanged(true, {});
+    QElapsedTimer timer;
+    timer.start();
+    ResourceMap map;
+    const QString error = map.open(m_containers);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    // read each resource file front to back instead of seeking all over them
+    QList<QPair<QString, const Entry *>> entries;
+    for (const auto e : finalEntries()) {
+        entries.append({m_containers[e->container]->resourcePath(e->flags2), e});
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+        return a.first == b.first ? a.second->resourcePos < b.second->resourcePos
+                                  : a.first < b.first;
+    });
+
+    QFile f(path.toLocalFile());
+    if (!f.open(QFile::WriteOnly)) {
+        emit statusChanged(false, u"Failed to open file: %1"_qs.arg(f.fileName()));
+        return;
+    }
+    qDebug() << "Starting archive export...";
+    tar::Writer writer(&f);
+    QByteArray buffer;
+    for (const auto &item : entries) {
+        const Entry *e = item.second;
+        const QByteArrayView packed = map.packed(m_containers[e->container], e);
+        if (packed.isNull()) {
+            f.close();
+            emit statusChanged(false, u"Failed to read resource file, resource file too small!"_qs);
+            return;
+        }
+        QByteArrayView data = packed;
+        if (e->size != e->sizePacked) {
+            if (!zutils::inflt(packed, buffer, e->size)) {
+                f.close();
+                emit statusChanged(false,
+                                   u"Failed to decompress asset, check for corrupt files!"_qs);
+                return;
+            }
+            data = buffer;
+        }
+        if (!writer.add(e->dst, data)) {
+            f.close();
+            emit statusChanged(false, u"Failed to write file: %1"_qs.arg(f.fileName()));
+            return;
+        }
+    }
+    const bool finished = writer.finish();
+    f.close();
+    if (!finished) {
+        emit statusChanged(false, u"Failed to write file: %1"_qs.arg(f.fileName()));
+        return;
+    }
+    if (withIndex) {
+        const QString indexError = tar::writeIndex(f.fileName() + u".index"_qs, writer.members());
+        if (!indexError.isEmpty()) {
+            emit statusChanged(false, indexError);
+            return;
+        }
+    }
+    qDebug() << "Archived" << f.size() / 1024 / 1024 << "mb of data in" << timer.elapsed() << "ms";
+    emit report(u"Archived %1 assets to %2"_qs.arg(entries.count()).arg(f.fileName()));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::findDuplicates()
+{
+    emit statusChanged(true, {});
+    if (!hashEntries()) {
+        return;
+    }
+    QHash<QPair<quint64, quint32>, QList<const Entry *>> groups;
+    for (const auto c : m_containers) {
+        for (const auto e : c->entries) {
+            groups[qMakePair(e->hash, e->size)].append(e);
+        }
+    }
+    int groupCount = 0;
+    int copies = 0;
+    qint64 savedBytes = 0;
+    for (const auto &group : qAsConst(groups)) {
+        if (group.count() < 2) {
+            continue;
+        }
+        ++groupCount;
+        copies += group.count() - 1;
+        savedBytes += static_cast<qint64>(group.count() - 1) * group.first()->size;
+        qDebug() << "Duplicate group:" << group.first()->dst << "x" << group.count();
+    }
+    qInfo() << "Found" << groupCount << "duplicate groups with" << copies << "extra copies,"
+            << savedBytes / 1024 / 1024 << "mb saved by deduplication";
+    emit report(u"%1 duplicate groups, %2 extra copies, %3 mb saved by deduplication"_qs
+                    .arg(groupCount)
+                    .arg(copies)
+                    .arg(savedBytes / 1024 / 1024));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::verifyAll()
+{
+    emit statusChanged(true, {});
+    QElapsedTimer timer;
+    timer.start();
+    ResourceMap map;
+    const QString error = map.open(m_containers);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    QList<Entry *> entries;
+    for (const auto c : m_containers) {
+        entries.append(c->entries);
+    }
+    qDebug() << "Verifying" << entries.count() << "entries...";
+    std::atomic<qint64> packedBytes = 0;
+    std::atomic<qint64> inflatedBytes = 0;
+    QtConcurrent::blockingMap(entries, [&](Entry *e) {
+        // a null view means the entry runs past the end of its resource file
+        const QByteArrayView packed = map.packed(m_containers[e->container], e);
+        bool intact = !packed.isNull();
+        if (intact && e->size != e->sizePacked) {
+            QByteArray output;
+            intact = zutils::inflt(packed, output, e->size) && output.size() == e->size;
+            inflatedBytes += output.size();
+        }
+        packedBytes += packed.size();
+        e->integrity = intact ? Entry::Intact : Entry::Corrupt;
+    });
+    map.close();
+
+    int failed = 0;
+    for (const auto e : qAsConst(entries)) {
+        if (e->integrity == Entry::Corrupt) {
+            ++failed;
+            emit searchResult(e);
+        }
+    }
+    const double seconds = qMax<qint64>(timer.elapsed(), 1) / 1000.0;
+    const double rate = (packedBytes.load() + inflatedBytes.load()) / 1024.0 / 1024.0 / seconds;
+    qInfo() << "Verified" << entries.count() << "entries," << failed << "failed,"
+            << packedBytes.load() << "bytes read," << inflatedBytes.load() << "bytes inflated in"
+            << seconds << "s";
+    emit report(u"Verified %1 entries in %2s (%3 mb/s), %4 failed"_qs.arg(entries.count())
+                    .arg(seconds, 0, 'f', 1)
+                    .arg(rate, 0, 'f', 0)
+                    .arg(failed));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::compactResources()
+{
+    emit statusChanged(true, {});
+    // only resource files we have left dead ranges in are worth rewriting
+    QSettings settings;
+    QStringList paths;
+    for (const auto c : m_containers) {
+        for (int ri = 0; ri < c->resources.count(); ++ri) {
+            const QString path = c->resourcePath(static_cast<quint16>(ri << 2));
+            if (settings.contains(orphanKey(path)) && !paths.contains(path)) {
+                paths.append(path);
+            }
+        }
+    }
+    if (paths.isEmpty()) {
+        emit report(u"Nothing to compact"_qs);
+        emit statusChanged(false, {});
+        return;
+    }
+    qint64 oldSize = 0;
+    qint64 newSize = 0;
+    for (const auto &path : paths) {
+        if (!compact(path, oldSize, newSize)) {
+            return;
+        }
+        settings.remove(orphanKey(path));
+    }
+    emit report(u"Compacted %1 resource files, reclaimed %2 mb, now %3 mb"_qs.arg(paths.count())
+                    .arg((oldSize - newSize) / 1024 / 1024)
+                    .arg(newSize / 1024 / 1024));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::setUseOverlay(bool useOverlay)
+{
+    m_useOverlay = useOverlay;
+}
+
+void ResourceManager::deployOverlay()
+{
+    emit statusChanged(true, {});
+    QElapsedTimer timer;
+    timer.start();
+    QHash<QString, Entry *> entries;
+    for (const auto c : m_containers) {
+        for (const auto e : c->entries) {
+            const QString key = overlayKey(c, e);
+            if (m_overlay.contains(key)) {
+                entries.insert(key, e);
+            }
+        }
+    }
+    // every overlay asset goes into a single transaction, it all lands or none of it does
+    Transaction tx(journalPath());
+    qint64 bytes = 0;
+    const QStringList keys = m_overlay.keys();
+    for (const auto &key : keys) {
+        Entry *e = entries.value(key);
+        if (!e) {
+            emit statusChanged(false,
+                               u"Overlay entry %1 is not in the indexes, discard it!"_qs.arg(key));
+            return;
+        }
+        QByteArray data;
+        const QString error = m_overlay.read(key, data);
+        if (!error.isEmpty()) {
+            emit statusChanged(false, error);
+            return;
+        }
+        bytes += data.size();
+        if (!insert(tx, e, data)) {
+            return;
+        }
+    }
+    if (!commit(tx)) {
+        return;
+    }
+    const QString error = m_overlay.clear();
+    emit overlayChanged(m_overlay.count());
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    emit report(u"Deployed %1 entries, %2 kb in %3ms"_qs.arg(keys.count())
+                    .arg(bytes / 1024)
+                    .arg(timer.elapsed()));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::discardOverlay()
+{
+    emit statusChanged(true, {});
+    const int count = m_overlay.count();
+    forgetLevel();
+    const QString error = m_overlay.clear();
+    emit overlayChanged(m_overlay.count());
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    emit report(u"Discarded %1 overlay entries"_qs.arg(count));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::exportPatches(QUrl path)
+{
+    emit statusChanged(true, {});
+    QElapsedTimer timer;
+    timer.start();
+    ResourceMap map;
+    const QString error = map.open(m_containers);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    // every overlay asset is diffed against what the game files still have
+    struct Job {
+        const Entry *entry;
+        QByteArray modified;
+        delta::Patch patch;
+        bool failed = false;
+    };
+    QList<Job> jobs;
+    for (const auto c : m_containers) {
+        for (const auto e : c->entries) {
+            const QString key = overlayKey(c, e);
+            if (!m_overlay.contains(key)) {
+                continue;
+            }
+            Job job{e, {}, {}};
+            const QString readError = m_overlay.read(key, job.modified);
+            if (!readError.isEmpty()) {
+                emit statusChanged(false, readError);
+                return;
+            }
+            jobs.append(job);
+        }
+    }
+    if (jobs.isEmpty()) {
+        emit statusChanged(false,
+                           u"Nothing in the overlay to export, save edits to it first!"_qs);
+        return;
+    }
+    QtConcurrent::blockingMap(jobs, [&](Job &job) {
+        const Entry *e = job.entry;
+        QByteArray original;
+        if (!unpack(map, m_containers[e->container], e, original)) {
+            job.failed = true;
+            return;
+        }
+        job.patch.id = e->id;
+        job.patch.dst = e->dst;
+        job.patch.originalHash = hashutils::xxh64(original);
+        job.patch.modifiedHash = hashutils::xxh64(job.modified);
+        job.patch.delta = delta::diff(original, job.modified);
+        job.modified.clear();
+    });
+    map.close();
+
+    QList<delta::Patch> patches;
+    qint64 deltaBytes = 0;
+    for (const auto &job : qAsConst(jobs)) {
+        if (job.failed) {
+            emit statusChanged(false, u"Failed to read original of %1, verify before exporting!"_qs
+                                          .arg(job.entry->dst));
+            return;
+        }
+        deltaBytes += job.patch.delta.size();
+        patches.append(job.patch);
+    }
+    const QString writeError = delta::write(path.toLocalFile(), patches);
+    if (!writeError.isEmpty()) {
+        emit statusChanged(false, writeError);
+        return;
+    }
+    emit report(u"Exported %1 patches, %2 kb of deltas in %3ms"_qs.arg(patches.count())
+                    .arg(deltaBytes / 1024)
+                    .arg(timer.elapsed()));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::importPatches(QUrl path)
+{
+    emit statusChanged(true, {});
+    QElapsedTimer timer;
+    timer.start();
+    QList<delta::Patch> patches;
+    QString error = delta::read(path.toLocalFile(), patches);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    ResourceMap map;
+    error = map.open(m_containers);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return;
+    }
+    // only entries the game actually uses are candidates, matched on id first
+    QMultiHash<quint32, Entry *> byId;
+    for (const auto e : finalEntries()) {
+        byId.insert(e->id, e);
+    }
+    struct Job {
+        const delta::Patch *patch;
+        QList<Entry *> candidates;
+        Entry *entry = nullptr;
+        QByteArray modified = {};
+    };
+    QList<Job> jobs;
+    jobs.reserve(patches.count());
+    for (const auto &p : qAsConst(patches)) {
+        jobs.append({&p, byId.values(p.id)});
+    }
+    QtConcurrent::blockingMap(jobs, [&](Job &job) {
+        // the original hash tells apart entries sharing an id and assets changed since
+        for (const auto e : qAsConst(job.candidates)) {
+            QByteArray original;
+            if (!unpack(map, m_containers[e->container], e, original)
+                || hashutils::xxh64(original) != job.patch->originalHash) {
+                continue;
+            }
+            QByteArray modified;
+            if (delta::apply(original, job.patch->delta, modified)
+                && hashutils::xxh64(modified) == job.patch->modifiedHash) {
+                job.entry = e;
+                job.modified = modified;
+                return;
+            }
+        }
+    });
+    map.close();
+
+    // everything that matched lands together, in the overlay or in one transaction
+    Transaction tx(journalPath());
+    QStringList skipped;
+    int applied = 0;
+    for (auto &job : jobs) {
+        if (!job.entry) {
+            skipped.append(job.patch->dst);
+            continue;
+        }
+        if (m_useOverlay) {
+            const Container *c = m_containers[job.entry->container];
+            error = m_overlay.write(overlayKey(c, job.entry), job.modified);
+            if (!error.isEmpty()) {
+                emit overlayChanged(m_overlay.count());
+                emit statusChanged(false, error);
+                return;
+            }
+        } else if (!insert(tx, job.entry, job.modified)) {
+            return;
+        }
+        job.modified.clear();
+        ++applied;
+    }
+    if (m_useOverlay) {
+        emit overlayChanged(m_overlay.count());
+    } else if (!commit(tx)) {
+        return;
+    }
+    for (const auto &dst : qAsConst(skipped)) {
+        qWarning() << "No matching original for patch" << dst;
+    }
+    emit report(u"Applied %1 of %2 patches in %3ms%4"_qs.arg(applied)
+                    .arg(patches.count())
+                    .arg(timer.elapsed())
+                    .arg(skipped.isEmpty() ? QString()
+                                           : u", %1 did not match this install"_qs.arg(
+                                                 skipped.count())));
+    emit statusChanged(false, {});
+}
+
 void ResourceManager::loadBwm(const QPointer<Entry> ref)
 {
     emit statusChanged(true, {});
     QByteArray data;
-    if (!extract(ref, data))
+    if (!extractLevel(ref, data))
         return;
     QList<bwm::PODObject> objects;
-    const QString error = bwm::parse(data, objects);
+    QList<bwm::Bounds> meshBounds;
+    bwm::Groups groups;
+    const QString error = bwm::parse(data, objects, &meshBounds, &groups);
     if (error.isEmpty()) {
-        emit bwmLoaded(ref, objects);
+        emit bwmLoaded(ref, objects, meshBounds, groups);
         emit statusChanged(false, {});
     } else {
         emit statusChanged(false, error);
     }
 }
 
-void ResourceManager::saveObject(const QPointer<Entry> ref, bwm::PODObject obj)
+void ResourceManager::exportMesh(const QPointer<Entry> ref, QUrl path)
 {
     emit statusChanged(true, {});
+    QElapsedTimer timer;
+    timer.start();
     QByteArray data;
-    if (!extract(ref, data)) {
+    if (!extract(ref, data))
         return;
-    }
-    const QString error = bwm::inject(obj, &data);
+    const QString file = path.toLocalFile();
+    const QString error = meshexport::write(data, file);
     if (!error.isEmpty()) {
         emit statusChanged(false, error);
         return;
     }
-    if (!insert(ref, data)) {
+    const QFileInfo info(file);
+    emit report(u"Exported %1 to %2, %3 kb in %4ms"_qs.arg(ref->dstFileName(),
+                                                            info.suffix().toUpper())
+                    .arg(info.size() / 1024)
+                    .arg(timer.elapsed()));
+    emit statusChanged(false, {});
+}
+
+void ResourceManager::benchmarkBwm()
+{
+    emit statusChanged(true, {});
+    ResourceMap map;
+    const QString error = map.open(m_containers);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
         return;
     }
+    // decompress everything first so only the parsers are being timed
+    QList<QPair<const Entry *, QByteArray>> levels;
+    for (const auto e : finalEntries()) {
+        if (e->dstSuffix() != u"bwm"_qs) {
+            continue;
+        }
+        QByteArray data;
+        if (!unpack(map, m_containers[e->container], e, data)) {
+            emit statusChanged(false, u"Failed to read %1, verify before benchmarking!"_qs.arg(
+                                          e->dst));
+            return;
+        }
+        levels.append({e, data});
+    }
+    map.close();
+
+    // each parser gets every level once to warm up, then is timed over a few passes
+    const auto timeParser = [&levels](auto parser, QList<QList<bwm::PODObject>> &results) {
+        QElapsedTimer timer;
+        for (int pass = 0; pass < 4; ++pass) {
+            if (pass == 1) {
+                timer.start();
+            }
+            results.clear();
+            for (const auto &level : qAsConst(levels)) {
+                QList<bwm::PODObject> objects;
+                parser(level.second, objects);
+                results.append(objects);
+            }
+        }
+        return timer.nsecsElapsed() / 3;
+    };
+    QList<QList<bwm::PODObject>> reference;
+    QList<QList<bwm::PODObject>> mapped;
+    const qint64 referenceNs = timeParser(bwm::parseReference, reference);
+    const qint64 mappedNs = timeParser(
+        [](const QByteArray &input, QList<bwm::PODObject> &objects) {
+            return bwm::parse(input, objects);
+        },
+        mapped);
+
+    // both parsers have to agree on every object, matrix and instance
+    int mismatched = 0;
+    for (int i = 0; i < levels.count(); ++i) {
+        bool same = reference[i].count() == mapped[i].count();
+        for (int o = 0; same && o < reference[i].count(); ++o) {
+            const auto &a = reference[i][o];
+            const auto &b = mapped[i][o];
+            same = a.offset == b.offset && a.indexStart == b.indexStart
+                   && a.indexEnd == b.indexEnd && a.meshIndex == b.meshIndex
+                   && a.materialPath == b.materialPath && a.lod == b.lod
+                   && a.matrices.count() == b.matrices.count()
+                   && a.instances.count() == b.instances.count();
+            for (int m = 0; same && m < a.matrices.count(); ++m) {
+                same = a.matrices[m].offset == b.matrices[m].offset
+                       && !std::memcmp(a.matrices[m].values, b.matrices[m].values,
+                                       sizeof(a.matrices[m].values));
+            }
+            for (int n = 0; same && n < a.instances.count(); ++n) {
+                same = a.instances[n].offset == b.instances[n].offset
+                       && !std::memcmp(a.instances[n].min, b.instances[n].min, 6 * 4);
+            }
+        }
+        if (!same) {
+            ++mismatched;
+            qWarning() << "Parsers disagree on" << levels[i].first->dst;
+        }
+    }
+    qint64 bytes = 0;
+    for (const auto &level : qAsConst(levels)) {
+        bytes += level.second.size();
+    }
+    // the vertex decoder's own half conversion has to agree with Qt's on every value
+    const int halves = vertex::checkHalves();
+    const double speedup = referenceNs / qMax<double>(mappedNs, 1);
+    qInfo() << "Parsed" << levels.count() << "levels," << bytes << "bytes, reference"
+            << referenceNs / 1000000.0 << "ms, mapped" << mappedNs / 1000000.0 << "ms";
+    emit report(u"Parsed %1 levels: reference %2ms, mapped %3ms (%4x), %5 mismatched"_qs
+                    .arg(levels.count())
+                    .arg(referenceNs / 1000000.0, 0, 'f', 1)
+                    .arg(mappedNs / 1000000.0, 0, 'f', 1)
+                    .arg(speedup, 0, 'f', 1)
+                    .arg(mismatched)
+                + u", %1 halves off"_qs.arg(halves));
     emit statusChanged(false, {});
 }
 
-void ResourceManager::saveObjects(const QPointer<Entry> ref, QList<bwm::PODObject> objects)
+void ResourceManager::indexLevels()
 {
     emit statusChanged(true, {});
-    QByteArray data;
-    if (!extract(ref, data)) {
-        return;
+    QElapsedTimer timer;
+    timer.start();
+    struct Job {
+        const Entry *entry;
+        QString stamp;
+        QString error;
+        QList<LevelIndex::Placement> objects;
+        qsizetype meshCount;
+    };
+    QList<Job> jobs;
+    QStringList levels;
+    qsizetype largest = 1;
+    for (const auto e : finalEntries()) {
+        if (e->dstSuffix() != u"bwm"_qs) {
+            continue;
+        }
+        const Container *c = m_containers[e->container];
+        levels.append(e->dst);
+        // levels in the overlay are the ones being edited, those always get parsed
+        const QString stamp = m_overlay.contains(overlayKey(c, e))
+                                  ? QString()
+                                  : u"%1|%2"_qs.arg(containerStamp(c)).arg(e->resourcePos);
+        if (stamp.isEmpty() || stamp != m_levelIndex.stamp(e->dst)) {
+            jobs.append({e, stamp, {}, {}, 0});
+            largest = qMax<qsizetype>(largest, e->size);
+        }
     }
-    const QString error = bwm::inject(objects, &data);
+    for (const auto &level : m_levelIndex.levels()) {
+        if (!levels.contains(level)) {
+            m_levelIndex.remove(level);
+        }
+    }
+
+    ResourceMap map;
+    const QString error = map.open(m_containers);
     if (!error.isEmpty()) {
         emit statusChanged(false, error);
         return;
     }
-    if (!insert(ref, data)) {
+    // a running job holds its level unpacked and parsed, roughly twice its size, so the
+    // biggest level decides how many run at once
+    QThreadPool pool;
+    pool.setMaxThreadCount(static_cast<int>(
+        qBound<qsizetype>(1, LEVEL_INDEX_BUDGET / (2 * largest), QThread::idealThreadCount())));
+    QtConcurrent::blockingMap(&pool, jobs, [&](Job &job) {
+        const Container *c = m_containers[job.entry->container];
+        const QString key = overlayKey(c, job.entry);
+        QByteArray data;
+        if (m_overlay.contains(key)) {
+            job.error = m_overlay.read(key, data);
+        } else if (!unpack(map, c, job.entry, data)) {
+            job.error = u"Failed to read %1"_qs.arg(job.entry->dst);
+        }
+        if (!job.error.isEmpty()) {
+            return;
+        }
+        bwm::Level level;
+        job.error = bwm::parseLevel(data, level);
+        data.clear();
+        // only the counts outlive the job, the parsed level goes with it
+        job.objects = LevelIndex::placements(level.objects);
+        job.meshCount = level.meshes.count();
+    });
+    map.close();
+
+    QStringList errors;
+    for (const auto &job : qAsConst(jobs)) {
+        if (job.error.isEmpty()) {
+            m_levelIndex.add(job.entry->dst, job.stamp, job.objects, job.meshCount);
+        } else {
+            m_levelIndex.remove(job.entry->dst);
+            errors.append(u"%1: %2"_qs.arg(job.entry->dst, job.error));
+        }
+    }
+    const QString saveError = m_levelIndex.save(levelIndexPath());
+    if (!saveError.isEmpty()) {
+        errors.append(saveError);
+    }
+    emit levelIndexChanged(m_levelIndex);
+
+    // mesh reuse across the whole game, a mesh counts as shared once several
+    // objects in its level place it
+    qint64 meshes = 0;
+    qint64 placed = 0;
+    qint64 shared = 0;
+    for (const auto &level : m_levelIndex.levels()) {
+        for (const auto &use : m_levelIndex.meshUses(level)) {
+            ++meshes;
+            placed += use.objects ? 1 : 0;
+            shared += use.objects > 1 ? 1 : 0;
+        }
+    }
+    const QString message = u"Indexed %1 levels (%2 parsed) in %3ms: %4 materials, %5 meshes, "
+                            u"%6 placed, %7 shared"_qs.arg(m_levelIndex.levels().count())
+                                .arg(jobs.count())
+                                .arg(timer.elapsed())
+                                .arg(m_levelIndex.materials().count())
+                                .arg(meshes)
+                                .arg(placed)
+                                .arg(shared);
+    qInfo() << message;
+    emit report(message);
+    emit statusChanged(false, errors.isEmpty() ? QString() : errors.join('\n'));
+}
+
+void ResourceManager::saveObject(const QPointer<Entry> ref, bwm::PODObject obj)
+{
+    emit statusChanged(true, {});
+    if (saveLevel(ref, {obj})) {
+        emit statusChanged(false, {});
+    }
+}
+
+void ResourceManager::saveObjects(const QPointer<Entry> ref, QList<bwm::PODObject> objects)
+{
+    emit statusChanged(true, {});
+    if (saveLevel(ref, objects)) {
+        emit statusChanged(false, {});
+    }
+}
+
+QList<Entry *> ResourceManager::finalEntries() const
+{
+    // later patch levels overwrite earlier ones in a full export, so only the
+    // last entry for each destination is ever actually kept
+    QHash<QString, Entry *> latest;
+    for (const auto c : m_containers) {
+        for (const auto e : c->entries) {
+            latest.insert(e->dst, e);
+        }
+    }
+    QList<Entry *> entries;
+    entries.reserve(latest.count());
+    for (const auto c : m_containers) {
+        for (const auto e : c->entries) {
+            if (latest.value(e->dst) == e) {
+                entries.append(e);
+            }
+        }
+    }
+    return entries;
+}
+
+bool ResourceManager::hashEntries()
+{
+    if (m_hashed) {
+        return true;
+    }
+
+    // pull in whatever is still valid from the last run
+    QHash<QString, QPair<QString, QList<quint64>>> cache;
+    QFile cacheFile(hashCachePath());
+    if (cacheFile.open(QFile::ReadOnly)) {
+        QDataStream in(&cacheFile);
+        quint32 magic;
+        in >> magic;
+        if (magic == HASH_CACHE_MAGIC) {
+            in >> cache;
+        }
+        cacheFile.close();
+    }
+    QList<Entry *> pending;
+    for (const auto c : m_containers) {
+        const auto cached = cache.value(c->path);
+        if (cached.first == containerStamp(c) && cached.second.count() == c->entries.count()) {
+            for (int ei = 0; ei < c->entries.count(); ++ei) {
+                c->entries[ei]->hash = cached.second[ei];
+            }
+        } else {
+            pending.append(c->entries);
+        }
+    }
+    qDebug() << "Reused cached hashes, hashing" << pending.count() << "entries...";
+
+    if (!pending.isEmpty()) {
+        QElapsedTimer timer;
+        timer.start();
+        ResourceMap map;
+        const QString error = map.open(m_containers);
+        if (!error.isEmpty()) {
+            emit statusChanged(false, error);
+            return false;
+        }
+        std::atomic<int> failed = 0;
+        std::atomic<qint64> bytes = 0;
+        QtConcurrent::blockingMap(pending, [&](Entry *e) {
+            const QByteArrayView packed = map.packed(m_containers[e->container], e);
+            if (packed.isNull()) {
+                e->hash = 0;
+                ++failed;
+                return;
+            }
+            e->hash = hashutils::xxh64(packed);
+            bytes += packed.size();
+        });
+        qInfo() << "Hashed" << pending.count() << "entries," << bytes.load() / 1024 / 1024
+                << "mb in" << timer.elapsed() << "ms";
+        if (failed) {
+            emit statusChanged(false, u"Failed to hash %1 entries, resource files too small!"_qs
+                                          .arg(failed.load()));
+            return false;
+        }
+    }
+
+    m_hashed = true;
+    saveHashCache();
+    return true;
+}
+
+void ResourceManager::saveHashCache() const
+{
+    QHash<QString, QPair<QString, QList<quint64>>> cache;
+    for (const auto c : m_containers) {
+        QList<quint64> hashes;
+        hashes.reserve(c->entries.count());
+        for (const auto e : c->entries) {
+            hashes.append(e->hash);
+        }
+        cache.insert(c->path, {containerStamp(c), hashes});
+    }
+    const QFileInfo info(hashCachePath());
+    QFile f(info.absoluteFilePath());
+    if (!info.dir().mkpath(info.absolutePath()) || !f.open(QFile::WriteOnly)) {
+        qWarning() << "Failed to open:" << f.fileName();
         return;
     }
-    emit statusChanged(false, {});
+    QDataStream out(&f);
+    out << static_cast<quint32>(HASH_CACHE_MAGIC) << cache;
+    f.close();
 }
 
 const Container *ResourceManager::container(const QPointer<Entry> ref)
@@ -381,10 +1329,10 @@ const Container *ResourceManager::container(const QPointer<Entry> ref)
     return c;
 }
 
-const Entry *ResourceManager::entry(const Container *c, const QPointer<Entry> ref)
+Entry *ResourceManager::entry(const Container *c, const QPointer<Entry> ref)
 {
     Entry *e = nullptr;
-    if (c->entries.count() >= ref->entry) {
+    if (c->entries.count() > ref->entry) {
         e = c->entries[ref->entry];
     } else {
         emit statusChanged(false, u"Invalid entry, try reloading indexes!"_qs);
@@ -402,6 +1350,16 @@ bool ResourceManager::extract(const QPointer<Entry> ref, QByteArray &output)
     if (!e)
         return false;
     qDebug() << "Starting extraction of" << e;
+    const QString key = overlayKey(c, e);
+    if (m_overlay.contains(key)) {
+        const QString error = m_overlay.read(key, output);
+        if (!error.isEmpty()) {
+            emit statusChanged(false, error);
+            return false;
+        }
+        qDebug() << "Finished extraction from overlay," << output.size() << "bytes!";
+        return true;
+    }
     QFile f(c->resourcePath(e->flags2));
     if (!f.open(QFile::ReadOnly)) {
         emit statusChanged(false, u"Failed to open resource file: %1"_qs.arg(f.fileName()));
@@ -419,7 +1377,7 @@ bool ResourceManager::extract(const QPointer<Entry> ref, QByteArray &output)
         return false;
     }
     if (e->size != e->sizePacked) {
-        if (!zutils::inflt(rawData, output)) {
+        if (!zutils::inflt(rawData, output, e->size)) {
             emit statusChanged(false, u"Failed to decompress asset, check for corrupt files!"_qs);
             return false;
         }
@@ -430,43 +1388,473 @@ bool ResourceManager::extract(const QPointer<Entry> ref, QByteArray &output)
     return true;
 }
 
-bool ResourceManager::insert(const QPointer<Entry> ref, QByteArray &rawData)
+bool ResourceManager::extractLevel(const QPointer<Entry> ref, QByteArray &data)
 {
     const Container *c = container(ref);
     if (!c)
         return false;
     const Entry *e = entry(c, ref);
+    if (!e)
+        return false;
+    const QString key = overlayKey(c, e);
+    if (key == m_levelKey) {
+        data = m_level;
+        return true;
+    }
+    if (!extract(ref, data)) {
+        return false;
+    }
+    m_levelKey = key;
+    m_level = data;
+    return true;
+}
+
+bool ResourceManager::saveLevel(const QPointer<Entry> ref, const QList<bwm::PODObject> &objects)
+{
+    QByteArray data;
+    if (!extractLevel(ref, data)) {
+        return false;
+    }
+    // drop the cached reference so inject patches data in place instead of copying it
+    const QString key = m_levelKey;
+    forgetLevel();
+    const QString error = bwm::inject(objects, &data);
+    if (!error.isEmpty()) {
+        emit statusChanged(false, error);
+        return false;
+    }
+    if (!save(ref, data)) {
+        return false;
+    }
+    // what we just wrote is the level now, the next save starts from it
+    m_levelKey = key;
+    m_level = data;
+    return true;
+}
+
+void ResourceManager::forgetLevel()
+{
+    m_levelKey.clear();
+    m_level.clear();
+}
+
+bool ResourceManager::insert(Transaction &tx, const QPointer<Entry> ref, QByteArray &rawData)
+{
+    // whatever is cached for this entry is about to go stale
+    forgetLevel();
+    const Container *c = container(ref);
+    if (!c)
+        return false;
+    Entry *e = entry(c, ref);
     if (!e)
         return false;
     qDebug() << "Starting insertion of" << e;
+    // the index has no compression flag, an entry is compressed when its packed size
+    // differs from its size, so whatever gets stored has to keep that true
+    bool compressed = e->size != e->sizePacked;
     QByteArray data;
-    if (e->size != e->sizePacked) {
+    if (compressed) {
         if (!zutils::deflt(rawData, data)) {
             emit statusChanged(false, u"Failed to compress asset!"_qs);
             return false;
         }
+        if (data.size() > e->sizePacked) {
+            // try harder before giving up the slot, if nothing fits we still
+            // relocate the smallest result
+            QElapsedTimer timer;
+            timer.start();
+            zutils::DeflateSettings winner;
+            const bool fits = zutils::fit(rawData, e->sizePacked, data, &winner);
+            if (data.isEmpty()) {
+                emit statusChanged(false, u"Failed to compress asset!"_qs);
+                return false;
+            }
+            const QString message = u"%1 %2 bytes with %3 after %4ms"_qs
+                                        .arg(fits ? u"Fit"_qs : u"Could not fit, packed"_qs)
+                                        .arg(data.size())
+                                        .arg(zutils::describe(winner))
+                                        .arg(timer.elapsed());
+            qInfo() << message;
+            emit report(message);
+        }
     } else {
         data = rawData;
     }
-    if (data.size() > e->sizePacked) {
-        emit statusChanged(false,
-                           u"Asset is too large, %1 > %2"_qs.arg(data.size()).arg(e->sizePacked));
+    if (compressed && data.size() >= rawData.size()) {
+        // deflate didn't help, storing it as is reads back the same
+        data = rawData;
+        compressed = false;
+    }
+    const QString resourcePath = c->resourcePath(e->flags2);
+    if (!QFileInfo::exists(resourcePath)) {
+        emit statusChanged(false, u"Failed to open resource file: %1"_qs.arg(resourcePath));
         return false;
-    } else if (data.size() < e->sizePacked) {
-        data.append('\0' * (e->sizePacked - data.size()));
     }
-    QFile f(c->resourcePath(e->flags2));
-    if (!f.open(QFile::ReadWrite)) {
-        emit statusChanged(false, u"Failed to open resource file: %1"_qs.arg(f.fileName()));
+    // assets that no longer fit their slot go on the end of the resource file,
+    // compressed assets that do fit are padded out to keep the slot the same size
+    const bool relocate = data.size() > e->sizePacked;
+    const quint64 pos = relocate ? static_cast<quint64>(tx.size(resourcePath)) : e->resourcePos;
+    if (compressed && !relocate) {
+        data.append(e->sizePacked - data.size(), '\0');
+        if (data.size() == rawData.size()) {
+            // padded out to exactly the raw size it would read as uncompressed, the raw
+            // bytes fill the slot just the same
+            data = rawData;
+        }
+    }
+    tx.write(resourcePath, static_cast<qint64>(pos), data);
+
+    // other patch levels can reference the same slot, keep all of them in step
+    const quint64 oldPos = e->resourcePos;
+    const quint32 oldSizePacked = e->sizePacked;
+    const quint32 size = static_cast<quint32>(rawData.size());
+    const quint32 sizePacked = static_cast<quint32>(data.size());
+    for (const auto sc : m_containers) {
+        for (const auto se : sc->entries) {
+            if (se->resourcePos != oldPos || sc->resourcePath(se->flags2) != resourcePath) {
+                continue;
+            }
+            if (se->resourcePos == pos && se->size == size && se->sizePacked == sizePacked) {
+                continue;
+            }
+            // the entry only changes once its index write is staged, and changes back
+            // if the transaction never lands
+            if (!writeIndexFields(tx, sc, se, pos, size, sizePacked)) {
+                return false;
+            }
+            const QPointer<Entry> sref(se);
+            const quint64 pos0 = se->resourcePos;
+            const quint32 size0 = se->size;
+            const quint32 sizePacked0 = se->sizePacked;
+            tx.onRollback([sref, pos0, size0, sizePacked0]() {
+                if (sref) {
+                    sref->resourcePos = pos0;
+                    sref->size = size0;
+                    sref->sizePacked = sizePacked0;
+                }
+            });
+            se->resourcePos = pos;
+            se->size = size;
+            se->sizePacked = sizePacked;
+        }
+    }
+    if (relocate) {
+        tx.onCommit([=]() { addOrphan(resourcePath, oldPos, oldSizePacked); });
+    } else if (sizePacked < oldSizePacked) {
+        tx.onCommit([=]() {
+            addOrphan(resourcePath, oldPos + sizePacked, oldSizePacked - sizePacked);
+        });
+    }
+    qDebug() << "Staged insertion," << data.size() << "bytes at" << pos;
+    return true;
+}
+
+bool ResourceManager::commit(Transaction &tx)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const QString error = tx.commit();
+    if (!error.isEmpty()) {
+        emit statusChanged(false, u"%1, changes were rolled back"_qs.arg(error));
         return false;
     }
-    if (!f.seek(e->resourcePos)) {
+    m_hashed = false;
+    qDebug() << "Finished saving in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool ResourceManager::save(const QPointer<Entry> ref, QByteArray &data)
+{
+    forgetLevel();
+    const Container *c = container(ref);
+    if (!c)
+        return false;
+    const Entry *e = entry(c, ref);
+    if (!e)
+        return false;
+    const QString key = overlayKey(c, e);
+    if (m_useOverlay) {
+        const QString error = m_overlay.write(key, data);
+        if (!error.isEmpty()) {
+            emit statusChanged(false, error);
+            return false;
+        }
+        qDebug() << "Saved" << data.size() << "bytes to overlay for" << e;
+        emit overlayChanged(m_overlay.count());
+        return true;
+    }
+    Transaction tx(journalPath());
+    if (!insert(tx, ref, data) || !commit(tx)) {
+        return false;
+    }
+    // the game files have the newest version now, don't let an older edit shadow it
+    if (m_overlay.contains(key)) {
+        const QString error = m_overlay.remove(key);
+        emit overlayChanged(m_overlay.count());
+        if (!error.isEmpty()) {
+            emit statusChanged(false, error);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ResourceManager::compact(const QString &resourcePath, qint64 &oldSize, qint64 &newSize)
+{
+    qInfo() << "Compacting" << resourcePath;
+    QElapsedTimer timer;
+    timer.start();
+
+    // every live slot in the file, shared by any entries pointing at the same data
+    struct Slot {
+        quint64 pos = 0;
+        quint32 size = 0;
+        quint32 sizePacked = 0;
+        QList<QPair<const Container *, Entry *>> refs;
+        quint64 newPos = 0;
+        quint32 newSizePacked = 0;
+        QByteArray blob;
+        bool failed = false;
+    };
+    QMap<QPair<quint64, quint32>, Slot> slotMap;
+    for (const auto c : m_containers) {
+        for (const auto e : c->entries) {
+            if (c->resourcePath(e->flags2) != resourcePath) {
+                continue;
+            }
+            Slot &slot = slotMap[qMakePair(e->resourcePos, e->sizePacked)];
+            slot.pos = e->resourcePos;
+            slot.size = e->size;
+            slot.sizePacked = e->sizePacked;
+            slot.refs.append({c, e});
+        }
+    }
+    QList<Slot> live = slotMap.values(); // QMap keeps these in offset order
+    slotMap.clear();
+
+    QFile src(resourcePath);
+    if (!src.open(QFile::ReadOnly)) {
+        emit statusChanged(false, u"Failed to open resource file: %1"_qs.arg(resourcePath));
+        return false;
+    }
+    const qint64 srcSize = src.size();
+    uchar *mem = src.map(0, srcSize);
+    // whatever comes before the first slot the indexes point at is the file's own
+    // header, it is kept as is whatever its length
+    const qint64 headerSize = live.isEmpty() ? srcSize : static_cast<qint64>(live.first().pos);
+    if (!mem || headerSize > srcSize) {
+        emit statusChanged(false, u"Failed to map resource file: %1"_qs.arg(resourcePath));
+        return false;
+    }
+    const QByteArrayView view(mem, srcSize);
+
+    QSaveFile dst(resourcePath);
+    if (!dst.open(QFile::WriteOnly)) {
+        emit statusChanged(false, u"Failed to open resource file: %1"_qs.arg(resourcePath));
+        return false;
+    }
+    dst.write(view.first(headerSize).toByteArray());
+
+    // repack in bounded batches so we never hold the whole file in memory
+    const auto repack = [view](Slot *slot) {
+        if (slot->pos + slot->sizePacked > static_cast<quint64>(view.size())) {
+            slot->failed = true;
+            return;
+        }
+        const QByteArrayView packed =
+            view.sliced(static_cast<qsizetype>(slot->pos), slot->sizePacked);
+        if (slot->size == slot->sizePacked) {
+            slot->blob = packed.toByteArray();
+            return;
+        }
+        QByteArray raw;
+        qsizetype consumed = 0;
+        const qsizetype size = slot->size;
+        if (!zutils::inflt(packed, raw, size, &consumed) || raw.size() != size) {
+            slot->failed = true;
+            return;
+        }
+        // drop padding after the stream, then see if a tighter deflate does better
+        QByteArray best = packed.first(consumed).toByteArray();
+        QByteArray recompressed;
+        zutils::DeflateSettings tight;
+        tight.level = 9;
+        tight.memLevel = 9;
+        if (zutils::deflt(raw, recompressed, tight) && recompressed.size() < best.size()) {
+            best = recompressed;
+        }
+        // packed and unpacked sizes matching would read as an uncompressed entry
+        slot->blob = best.size() == size ? packed.toByteArray() : best;
+    };
+    int next = 0;
+    while (next < live.count()) {
+        QList<Slot *> batch;
+        qint64 batchBytes = 0;
+        while (next < live.count() && (batch.isEmpty() || batchBytes < COMPACT_BATCH_BYTES)) {
+            batchBytes += live[next].size;
+            batch.append(&live[next++]);
+        }
+        QtConcurrent::blockingMap(batch, repack);
+        for (const auto slot : qAsConst(batch)) {
+            if (slot->failed) {
+                dst.cancelWriting();
+                emit statusChanged(false, u"Failed to repack %1 at %2, verify before compacting!"_qs
+                                              .arg(slot->refs.first().second->dst)
+                                              .arg(slot->pos));
+                return false;
+            }
+            slot->newPos = static_cast<quint64>(dst.pos());
+            slot->newSizePacked = static_cast<quint32>(slot->blob.size());
+            if (dst.write(slot->blob) != slot->blob.size()) {
+                dst.cancelWriting();
+                emit statusChanged(false,
+                                   u"Failed to write resource file: %1"_qs.arg(resourcePath));
+                return false;
+            }
+            slot->blob.clear();
+        }
+    }
+
+    // patch every index pointing into this file in memory, then write them out
+    QHash<const Container *, QByteArray> indexes;
+    for (const auto &slot : qAsConst(live)) {
+        for (const auto &ref : slot.refs) {
+            indexes[ref.first];
+        }
+    }
+    QList<QSaveFile *> indexFiles;
+    const auto cancel = [&](const QString &error) {
+        dst.cancelWriting();
+        for (const auto f : qAsConst(indexFiles)) {
+            f->cancelWriting();
+        }
+        qDeleteAll(indexFiles);
+        emit statusChanged(false, error);
+        return false;
+    };
+    for (auto it = indexes.begin(); it != indexes.end(); ++it) {
+        QFile f(it.key()->indexPath());
+        if (!f.open(QFile::ReadOnly)) {
+            return cancel(u"Failed to open index file: %1"_qs.arg(f.fileName()));
+        }
+        it.value() = f.readAll();
         f.close();
-        emit statusChanged(false, u"Failed to write resource file, check for corrupt files!"_qs);
+    }
+    for (const auto &slot : qAsConst(live)) {
+        for (const auto &ref : slot.refs) {
+            QBuffer buffer(&indexes[ref.first]);
+            buffer.open(QIODevice::ReadWrite);
+            const qint64 fieldsPos = indexFieldsPos(&buffer, ref.second->indexPos);
+            if (fieldsPos < 0 || !buffer.seek(fieldsPos)) {
+                return cancel(u"Failed to find %1 in index, try reloading indexes!"_qs.arg(
+                    ref.second->dst));
+            }
+            QDataStream out(&buffer);
+            out.setByteOrder(QDataStream::BigEndian);
+            out << slot.newPos << slot.size << slot.newSizePacked;
+        }
+    }
+    for (auto it = indexes.cbegin(); it != indexes.cend(); ++it) {
+        QSaveFile *f = new QSaveFile(it.key()->indexPath());
+        indexFiles.append(f);
+        if (!f->open(QFile::WriteOnly) || f->write(it.value()) != it.value().size()) {
+            return cancel(u"Failed to write index file: %1"_qs.arg(f->fileName()));
+        }
+    }
+
+    // everything is staged next to the originals. Those stay reachable through hard
+    // links until every file is swapped in, so a failed swap can put back the ones
+    // that already went through
+    QStringList replaced = {resourcePath};
+    for (const auto f : qAsConst(indexFiles)) {
+        replaced.append(f->fileName());
+    }
+    const auto removeBackups = [&replaced]() {
+        for (const auto &path : qAsConst(replaced)) {
+            QFile::remove(path + COMPACT_BACKUP_SUFFIX);
+        }
+    };
+    for (const auto &path : qAsConst(replaced)) {
+        if (!fsutils::hardLink(path, path + COMPACT_BACKUP_SUFFIX)) {
+            removeBackups();
+            return cancel(u"Failed to back up file: %1"_qs.arg(path));
+        }
+    }
+    src.unmap(mem);
+    src.close();
+    const qint64 compactedSize = dst.size();
+    qsizetype swapped = dst.commit() ? 1 : 0;
+    bool ok = swapped == 1;
+    for (const auto f : qAsConst(indexFiles)) {
+        ok = ok && f->commit();
+        if (ok) {
+            ++swapped;
+        } else {
+            f->cancelWriting();
+        }
+    }
+    qDeleteAll(indexFiles);
+    if (swapped != replaced.count()) {
+        for (qsizetype i = 0; i < swapped; ++i) {
+            QFile::remove(replaced[i]);
+            if (!QFile::rename(replaced[i] + COMPACT_BACKUP_SUFFIX, replaced[i])) {
+                emit statusChanged(false, u"Failed to restore %1, the original is at %2!"_qs.arg(
+                                              replaced[i], replaced[i] + COMPACT_BACKUP_SUFFIX));
+                return false;
+            }
+        }
+        removeBackups();
+        emit statusChanged(false, u"Failed to replace %1, nothing was changed"_qs.arg(
+                                      replaced[swapped]));
         return false;
     }
-    f.write(data);
+    removeBackups();
+    for (const auto &slot : qAsConst(live)) {
+        for (const auto &ref : slot.refs) {
+            ref.second->resourcePos = slot.newPos;
+            ref.second->sizePacked = slot.newSizePacked;
+        }
+    }
+    m_hashed = false;
+    oldSize += srcSize;
+    newSize += compactedSize;
+    qInfo() << "Compacted" << resourcePath << "from" << srcSize << "to" << compactedSize
+            << "bytes in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool ResourceManager::writeIndexFields(Transaction &tx, const Container *c, const Entry *e,
+                                       const quint64 pos, const quint32 size,
+                                       const quint32 sizePacked)
+{
+    QFile f(c->indexPath());
+    if (!f.open(QFile::ReadOnly)) {
+        emit statusChanged(false, u"Failed to open index file: %1"_qs.arg(f.fileName()));
+        return false;
+    }
+    const qint64 fieldsPos = indexFieldsPos(&f, e->indexPos);
     f.close();
-    qDebug() << "Finished insertion," << data.size() << "bytes!";
+    if (fieldsPos < 0) {
+        emit statusChanged(false,
+                           u"Failed to find %1 in index, try reloading indexes!"_qs.arg(e->dst));
+        return false;
+    }
+    QByteArray fields;
+    QDataStream out(&fields, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::BigEndian);
+    out << pos << size << sizePacked;
+    tx.write(c->indexPath(), fieldsPos, fields);
+    qDebug() << "Relinked" << e << "to" << pos;
     return true;
 }
+
+void ResourceManager::addOrphan(const QString &resourcePath, quint64 pos, quint32 size)
+{
+    // dead ranges left behind in the resource files, for compaction to reclaim later
+    QSettings settings;
+    const QString key = orphanKey(resourcePath);
+    QStringList ranges = settings.value(key).toStringList();
+    ranges.append(u"%1:%2"_qs.arg(pos).arg(size));
+    settings.setValue(key, ranges);
+    qInfo() << "Orphaned" << size << "bytes at" << pos << "in" << resourcePath;
+}
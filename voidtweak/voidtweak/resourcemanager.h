@@ -7,9 +7,12 @@
 
 #include "bwm.h"
 #include "decl.h"
+#include "levelindex.h"
+#include "overlay.h"
 
 class Entry;
 class Container;
+class Transaction;
 
 class ResourceManager : public QObject
 {
@@ -23,8 +26,12 @@ class ResourceManager : public QObject
     void indexesLoaded(int containerCount, int entryCount);
     void searchResult(const QPointer<Entry> entry);
     void extractResult(const QPointer<Entry> ref, QByteArray data);
-    void entitiesLoaded(const QPointer<Entry> ref, QList<decl::Scope> entities);
-    void bwmLoaded(const QPointer<Entry> ref, QList<bwm::PODObject> objects);
+    void entitiesLoaded(const QPointer<Entry> ref, decl::Tree tree);
+    void bwmLoaded(const QPointer<Entry> ref, QList<bwm::PODObject> objects,
+                   QList<bwm::Bounds> meshBounds, bwm::Groups groups);
+    void report(QString message);
+    void overlayChanged(int count);
+    void levelIndexChanged(LevelIndex index);
 
   public slots:
     void loadIndexes();
@@ -33,22 +40,55 @@ class ResourceManager : public QObject
     void insertEntry(const QPointer<Entry> ref, QByteArray data);
     void exportEntry(const QPointer<Entry> ref, QUrl path);
     void importEntry(const QPointer<Entry> ref, QUrl path);
+    void importFromArchive(const QPointer<Entry> ref, QUrl path);
     void loadEntities(const QPointer<Entry> ref);
     void exportAllEntries(QUrl path);
+    void exportUniqueEntries(QUrl path);
+    void exportArchive(QUrl path, bool withIndex);
+    void findDuplicates();
+    void verifyAll();
+    void compactResources();
     void loadBwm(const QPointer<Entry> ref);
+    void exportMesh(const QPointer<Entry> ref, QUrl path);
     void saveObject(const QPointer<Entry> ref, bwm::PODObject obj);
     void saveObjects(const QPointer<Entry> ref, QList<bwm::PODObject> objects);
+    void setUseOverlay(bool useOverlay);
+    void deployOverlay();
+    void discardOverlay();
+    void exportPatches(QUrl path);
+    void importPatches(QUrl path);
+    void benchmarkBwm();
+    void indexLevels();
 
   private:
     QList<Container *> m_containers;
+    bool m_hashed;
+    bool m_useOverlay;
+    Overlay m_overlay;
+    LevelIndex m_levelIndex;
+    // the last level loaded or saved, decompressed, so saving edits skips extract
+    QString m_levelKey;
+    QByteArray m_level;
 
     bool loadMasterIndex();
     bool loadChildIndexes();
+    QList<Entry *> finalEntries() const;
+    bool hashEntries();
+    void saveHashCache() const;
 
     const Container *container(const QPointer<Entry> ref);
-    const Entry *entry(const Container *c, const QPointer<Entry> ref);
+    Entry *entry(const Container *c, const QPointer<Entry> ref);
     bool extract(const QPointer<Entry> ref, QByteArray &data);
-    bool insert(const QPointer<Entry> ref, QByteArray &data);
+    bool extractLevel(const QPointer<Entry> ref, QByteArray &data);
+    bool saveLevel(const QPointer<Entry> ref, const QList<bwm::PODObject> &objects);
+    void forgetLevel();
+    bool insert(Transaction &tx, const QPointer<Entry> ref, QByteArray &data);
+    bool commit(Transaction &tx);
+    bool save(const QPointer<Entry> ref, QByteArray &data);
+    bool compact(const QString &resourcePath, qint64 &oldSize, qint64 &newSize);
+    bool writeIndexFields(Transaction &tx, const Container *c, const Entry *e, quint64 pos,
+                          quint32 size, quint32 sizePacked);
+    void addOrphan(const QString &resourcePath, quint64 pos, quint32 size);
 };
 
 #endif // RESOURCEMANAGER_H
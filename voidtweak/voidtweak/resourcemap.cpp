@@ -0,0 +1,58 @@
+#include "resourcemap.h"
+
+#include <QFile>
+
+#include "container.h"
+#include "entry.h"
+
+ResourceMap::~ResourceMap() { close(); }
+
+QString ResourceMap::open(const QList<Container *> &containers)
+{
+    close();
+    for (const auto c : containers) {
+        for (int ri = 0; ri < c->resources.count(); ++ri) {
+            // resourcePath wants the index packed into flags like an entry has it
+            const QString path = c->resourcePath(static_cast<quint16>(ri << 2));
+            if (path.isEmpty() || m_files.contains(path)) {
+                continue;
+            }
+            QFile *f = new QFile(path);
+            m_files.insert(path, f);
+            if (!f->open(QFile::ReadOnly)) {
+                return u"Failed to open resource file: %1"_qs.arg(path);
+            }
+            if (f->size() == 0) {
+                m_views.insert(path, {});
+                continue;
+            }
+            const uchar *data = f->map(0, f->size());
+            if (!data) {
+                return u"Failed to map resource file: %1"_qs.arg(path);
+            }
+            m_views.insert(path, QByteArrayView(data, f->size()));
+        }
+    }
+    return {};
+}
+
+void ResourceMap::close()
+{
+    m_views.clear();
+    for (const auto f : qAsConst(m_files)) {
+        f->close(); // also unmaps
+        delete f;
+    }
+    m_files.clear();
+}
+
+qint64 ResourceMap::fileSize(const QString &path) const { return m_views.value(path).size(); }
+
+QByteArrayView ResourceMap::packed(const Container *c, const Entry *e) const
+{
+    const QByteArrayView view = m_views.value(c->resourcePath(e->flags2));
+    if (e->resourcePos + e->sizePacked > static_cast<quint64>(view.size())) {
+        return {};
+    }
+    return view.sliced(static_cast<qsizetype>(e->resourcePos), e->sizePacked);
+}
@@ -0,0 +1,35 @@
+#ifndef RESOURCEMAP_H
+#define RESOURCEMAP_H
+
+#include <QByteArrayView>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+class Container;
+class Entry;
+class QFile;
+
+// read-only mappings of every resource file used by a set of containers, bulk
+// jobs share these across worker threads instead of each opening and seeking
+// its own QFile for every entry
+class ResourceMap
+{
+  public:
+    ResourceMap() = default;
+    ~ResourceMap();
+    ResourceMap(const ResourceMap &) = delete;
+    ResourceMap &operator=(const ResourceMap &) = delete;
+
+    QString open(const QList<Container *> &containers);
+    void close();
+    qint64 fileSize(const QString &path) const;
+    // null view if the entry does not fit inside its resource file
+    QByteArrayView packed(const Container *c, const Entry *e) const;
+
+  private:
+    QHash<QString, QFile *> m_files;
+    QHash<QString, QByteArrayView> m_views;
+};
+
+#endif // RESOURCEMAP_H
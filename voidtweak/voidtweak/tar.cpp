@@ -0,0 +1,180 @@
+#include "tar.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <cstring>
+
+#define TAR_BLOCK 512
+
+namespace tar
+{
+
+namespace
+{
+
+// write value as a NUL terminated, zero padded octal string filling the field
+void octal(char *field, const int width, qint64 value)
+{
+    field[width - 1] = '\0';
+    for (int i = width - 2; i >= 0; --i) {
+        field[i] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+qint64 padding(const qint64 size) { return (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK; }
+
+// find a member by walking headers, used when there is no index alongside the archive
+bool scan(QFile &f, const QByteArray &name, Member &member)
+{
+    QByteArray longName;
+    char header[TAR_BLOCK];
+    while (f.read(header, TAR_BLOCK) == TAR_BLOCK && header[0] != '\0') {
+        const qint64 size = QByteArray(header + 124, 11).toLongLong(nullptr, 8);
+        const qint64 dataPos = f.pos();
+        if (header[156] == 'x') {
+            const QByteArray pax = f.read(size);
+            const auto start = pax.indexOf(" path=");
+            if (start >= 0) {
+                longName = pax.sliced(start + 6, pax.indexOf('\n', start) - start - 6);
+            }
+        } else {
+            const QByteArray memberName =
+                longName.isEmpty() ? QByteArray(header, qstrnlen(header, 100)) : longName;
+            longName.clear();
+            if (memberName == name) {
+                member = {QString::fromUtf8(name), dataPos, size};
+                return true;
+            }
+        }
+        if (!f.seek(dataPos + size + padding(size))) {
+            break;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+Writer::Writer(QIODevice *device)
+    : m_device(device)
+{
+}
+
+bool Writer::add(const QString &path, QByteArrayView data)
+{
+    const QByteArray name = path.toUtf8();
+    if (name.size() >= 100) {
+        // record length counts its own digits, so settle it iteratively
+        const QByteArray record = " path=" + name + "\n";
+        qsizetype length = record.size();
+        while (QByteArray::number(length).size() + record.size() != length) {
+            length = QByteArray::number(length).size() + record.size();
+        }
+        const QByteArray pax = QByteArray::number(length) + record;
+        if (!writeHeader("././@PaxHeader", pax.size(), 'x') || m_device->write(pax) != pax.size() ||
+            !writePadding(pax.size())) {
+            return false;
+        }
+    }
+    if (!writeHeader(name.first(qMin<qsizetype>(name.size(), 99)), data.size(), '0')) {
+        return false;
+    }
+    m_members.append({path, m_device->pos(), data.size()});
+    if (m_device->write(data.data(), data.size()) != data.size()) {
+        return false;
+    }
+    return writePadding(data.size());
+}
+
+bool Writer::finish()
+{
+    const QByteArray end(TAR_BLOCK * 2, '\0');
+    return m_device->write(end) == end.size();
+}
+
+bool Writer::writeHeader(const QByteArray &name, qint64 size, char type)
+{
+    char header[TAR_BLOCK] = {};
+    memcpy(header, name.constData(), qMin<qsizetype>(name.size(), 99));
+    octal(header + 100, 8, 0644);                                    // mode
+    octal(header + 108, 8, 0);                                       // uid
+    octal(header + 116, 8, 0);                                       // gid
+    octal(header + 124, 12, size);                                   // size
+    octal(header + 136, 12, QDateTime::currentSecsSinceEpoch());     // mtime
+    memset(header + 148, ' ', 8);                                    // checksum placeholder
+    header[156] = type;                                              // typeflag
+    memcpy(header + 257, "ustar", 6);                                // magic
+    memcpy(header + 263, "00", 2);                                   // version
+    quint32 checksum = 0;
+    for (int i = 0; i < TAR_BLOCK; ++i) {
+        checksum += static_cast<uchar>(header[i]);
+    }
+    octal(header + 148, 7, checksum);
+    header[155] = ' ';
+    return m_device->write(header, TAR_BLOCK) == TAR_BLOCK;
+}
+
+bool Writer::writePadding(qint64 size)
+{
+    static const char zeros[TAR_BLOCK] = {};
+    const qint64 pad = padding(size);
+    return m_device->write(zeros, pad) == pad;
+}
+
+QString writeIndex(const QString &path, const QList<Member> &members)
+{
+    QFile f(path);
+    if (!f.open(QFile::WriteOnly)) {
+        return u"Failed to open file: %1"_qs.arg(path);
+    }
+    QByteArray line;
+    for (const auto &m : members) {
+        line.setNum(m.offset);
+        line.append('\t').append(QByteArray::number(m.size)).append('\t');
+        line.append(m.path.toUtf8()).append('\n');
+        if (f.write(line) != line.size()) {
+            f.close();
+            return u"Failed to write file: %1"_qs.arg(path);
+        }
+    }
+    f.close();
+    return {};
+}
+
+QString read(const QString &archivePath, const QString &member, QByteArray &output)
+{
+    Member found = {{}, -1, 0};
+    QFile index(archivePath + u".index"_qs);
+    if (index.open(QFile::ReadOnly)) {
+        const QByteArray name = member.toUtf8();
+        while (!index.atEnd()) {
+            const QList<QByteArray> parts = index.readLine().chopped(1).split('\t');
+            if (parts.count() == 3 && parts[2] == name) {
+                found = {member, parts[0].toLongLong(), parts[1].toLongLong()};
+                break;
+            }
+        }
+        index.close();
+    }
+    QFile f(archivePath);
+    if (!f.open(QFile::ReadOnly)) {
+        return u"Failed to open archive: %1"_qs.arg(archivePath);
+    }
+    if (found.offset < 0 && !scan(f, member.toUtf8(), found)) {
+        f.close();
+        return u"No member %1 in archive: %2"_qs.arg(member, archivePath);
+    }
+    if (!f.seek(found.offset)) {
+        f.close();
+        return u"Member %1 beyond end of archive!"_qs.arg(member);
+    }
+    output = f.read(found.size);
+    f.close();
+    if (output.size() != found.size) {
+        return u"Member %1 truncated in archive!"_qs.arg(member);
+    }
+    return {};
+}
+
+} // namespace tar
@@ -0,0 +1,55 @@
+#ifndef TAR_H
+#define TAR_H
+
+#include <QByteArrayView>
+#include <QIODevice>
+#include <QList>
+#include <QString>
+
+/* Minimal POSIX ustar writer/reader (little more than what GNU tar and 7-zip need)
+ * struct Member {
+ *   Header       // 512 bytes, octal text fields, see writeHeader
+ *   char[n]      // member data
+ *   char[pad]    // zero padding up to the next 512 byte block
+ * }
+ *
+ * Paths that do not fit the 100 byte name field are preceded by a pax 'x'
+ * member with a "path=" record. The archive ends with two zeroed blocks.
+ *
+ * The optional index is a text file next to the archive, one member per line:
+ *   <data offset>\t<size>\t<path>\n
+ */
+
+namespace tar
+{
+
+struct Member {
+    QString path;
+    qint64 offset; // offset of the member data (not header) in the archive
+    qint64 size;
+};
+
+class Writer
+{
+  public:
+    explicit Writer(QIODevice *device);
+    bool add(const QString &path, QByteArrayView data);
+    bool finish();
+    const QList<Member> &members() const { return m_members; }
+
+  private:
+    QIODevice *m_device;
+    QList<Member> m_members;
+
+    bool writeHeader(const QByteArray &name, qint64 size, char type);
+    bool writePadding(qint64 size);
+};
+
+QString writeIndex(const QString &path, const QList<Member> &members);
+
+// pull a single member back out, uses the index next to the archive if present
+QString read(const QString &archivePath, const QString &member, QByteArray &output);
+
+} // namespace tar
+
+#endif // TAR_H
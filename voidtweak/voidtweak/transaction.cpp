@@ -0,0 +1,204 @@
+#include "transaction.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+
+#include "fsutils.h"
+#include "qtutils.h"
+
+#define JOURNAL_MAGIC 0x56544a31 // "VTJ1"
+
+Transaction::Transaction(const QString &journalPath)
+    : m_journalPath(journalPath)
+{
+}
+
+Transaction::~Transaction()
+{
+    runRollbackCallbacks();
+}
+
+void Transaction::write(const QString &path, const qint64 pos, const QByteArray &data)
+{
+    m_writes[path].append({pos, data});
+}
+
+qint64 Transaction::size(const QString &path) const
+{
+    qint64 result = QFileInfo(path).size();
+    for (const auto &w : m_writes.value(path)) {
+        result = qMax(result, w.pos + w.data.size());
+    }
+    return result;
+}
+
+void Transaction::onCommit(const std::function<void()> &callback)
+{
+    m_onCommit.append(callback);
+}
+
+void Transaction::onRollback(const std::function<void()> &callback)
+{
+    m_onRollback.append(callback);
+}
+
+QString Transaction::commit()
+{
+    for (auto &writes : m_writes) {
+        std::stable_sort(writes.begin(), writes.end(),
+                         [](const Write &a, const Write &b) { return a.pos < b.pos; });
+    }
+    QString error = writeJournal();
+    if (!error.isEmpty()) {
+        rollback();
+        return error;
+    }
+
+    // one pass per file in offset order, and a single flush to disk at the end of it
+    for (auto it = m_writes.cbegin(); it != m_writes.cend(); ++it) {
+        QFile f(it.key());
+        if (!f.open(QFile::ReadWrite)) {
+            error = u"Failed to open file: %1"_qs.arg(f.fileName());
+        }
+        for (const auto &w : it.value()) {
+            if (!error.isEmpty()) {
+                break;
+            }
+            if (!f.seek(w.pos) || f.write(w.data) != w.data.size()) {
+                error = u"Failed to write file: %1"_qs.arg(f.fileName());
+            }
+        }
+        if (error.isEmpty() && !fsutils::sync(f)) {
+            error = u"Failed to flush file: %1"_qs.arg(f.fileName());
+        }
+        f.close();
+        if (!error.isEmpty()) {
+            rollback();
+            return error;
+        }
+    }
+    QFile::remove(m_journalPath);
+    qDebug() << "Committed transaction to" << m_writes.count() << "files";
+    for (const auto &callback : qAsConst(m_onCommit)) {
+        callback();
+    }
+    m_writes.clear();
+    m_onCommit.clear();
+    m_onRollback.clear();
+    return {};
+}
+
+QString Transaction::writeJournal() const
+{
+    QDir().mkpath(QFileInfo(m_journalPath).absolutePath());
+    QSaveFile journal(m_journalPath);
+    if (!journal.open(QFile::WriteOnly)) {
+        return u"Failed to open journal: %1"_qs.arg(m_journalPath);
+    }
+    QDataStream out(&journal);
+    out << quint32(JOURNAL_MAGIC) << qint32(m_writes.count());
+    for (auto it = m_writes.cbegin(); it != m_writes.cend(); ++it) {
+        QFile f(it.key());
+        if (!f.open(QFile::ReadOnly)) {
+            journal.cancelWriting();
+            return u"Failed to open file: %1"_qs.arg(f.fileName());
+        }
+        // anything staged past the end only needs truncating away on rollback
+        const qint64 size = f.size();
+        out << it.key() << size << qint32(it.value().count());
+        for (const auto &w : it.value()) {
+            const qint64 length = qBound(qint64(0), size - w.pos, qint64(w.data.size()));
+            QByteArray original;
+            if (length > 0 && f.seek(w.pos)) {
+                original = f.read(length);
+            }
+            if (original.size() != length) {
+                journal.cancelWriting();
+                return u"Failed to read file: %1"_qs.arg(f.fileName());
+            }
+            out << w.pos << original;
+        }
+        f.close();
+    }
+    // QSaveFile flushes to disk before swapping the journal in
+    if (out.status() != QDataStream::Ok || !journal.commit()) {
+        return u"Failed to write journal: %1"_qs.arg(m_journalPath);
+    }
+    return {};
+}
+
+void Transaction::rollback()
+{
+    const QString error = recover(m_journalPath);
+    if (!error.isEmpty()) {
+        qWarning() << "Rollback failed:" << error;
+    }
+    runRollbackCallbacks();
+    m_writes.clear();
+    m_onCommit.clear();
+    m_onRollback.clear();
+}
+
+void Transaction::runRollbackCallbacks()
+{
+    // newest first like any undo log, something changed twice ends up as it started
+    for (auto it = m_onRollback.crbegin(); it != m_onRollback.crend(); ++it) {
+        (*it)();
+    }
+    m_onRollback.clear();
+}
+
+QString Transaction::recover(const QString &journalPath)
+{
+    QFile journal(journalPath);
+    if (!journal.exists()) {
+        return {};
+    }
+    if (!journal.open(QFile::ReadOnly)) {
+        return u"Failed to open journal: %1"_qs.arg(journalPath);
+    }
+    QDataStream in(&journal);
+    quint32 magic;
+    qint32 fileCount;
+    in >> magic >> fileCount;
+    if (magic != JOURNAL_MAGIC) {
+        // never got as far as touching the game files
+        journal.close();
+        journal.remove();
+        return {};
+    }
+    for (qint32 i = 0; i < fileCount && in.status() == QDataStream::Ok; ++i) {
+        QString path;
+        qint64 size;
+        qint32 rangeCount;
+        in >> path >> size >> rangeCount;
+        QFile f(path);
+        if (!f.open(QFile::ReadWrite)) {
+            return u"Failed to open file: %1"_qs.arg(path);
+        }
+        for (qint32 r = 0; r < rangeCount && in.status() == QDataStream::Ok; ++r) {
+            qint64 pos;
+            QByteArray original;
+            in >> pos >> original;
+            if (!original.isEmpty() && (!f.seek(pos) || f.write(original) != original.size())) {
+                return u"Failed to restore file: %1"_qs.arg(path);
+            }
+        }
+        if (!f.resize(size) || !fsutils::sync(f)) {
+            return u"Failed to restore file: %1"_qs.arg(path);
+        }
+        f.close();
+        qInfo() << "Restored" << path << "from journal";
+    }
+    if (in.status() != QDataStream::Ok) {
+        return u"Journal is damaged: %1"_qs.arg(journalPath);
+    }
+    journal.close();
+    journal.remove();
+    return {};
+}
@@ -0,0 +1,52 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <functional>
+
+// a set of writes to the game files that either all land or none do, the
+// original bytes of every range are journaled before anything is touched so a
+// crash part way through can be rolled back on the next start
+class Transaction
+{
+  public:
+    explicit Transaction(const QString &journalPath);
+    // anything staged but never committed is discarded along with its callbacks
+    ~Transaction();
+    Transaction(const Transaction &) = delete;
+    Transaction &operator=(const Transaction &) = delete;
+
+    // stage data to go at pos in the file, nothing is written until commit
+    void write(const QString &path, qint64 pos, const QByteArray &data);
+    // size the file will have once every staged write has been applied
+    qint64 size(const QString &path) const;
+    // run once the transaction is on disk, or when it has been rolled back, rollback
+    // callbacks run in reverse order
+    void onCommit(const std::function<void()> &callback);
+    void onRollback(const std::function<void()> &callback);
+    bool isEmpty() const { return m_writes.isEmpty(); }
+
+    QString commit();
+    // restore the files listed in a journal left behind by an interrupted commit
+    static QString recover(const QString &journalPath);
+
+  private:
+    struct Write {
+        qint64 pos;
+        QByteArray data;
+    };
+
+    QString writeJournal() const;
+    void rollback();
+    void runRollbackCallbacks();
+
+    QString m_journalPath;
+    QMap<QString, QList<Write>> m_writes;
+    QList<std::function<void()>> m_onCommit;
+    QList<std::function<void()>> m_onRollback;
+};
+
+#endif // TRANSACTION_H
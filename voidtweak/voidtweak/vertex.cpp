@@ -0,0 +1,266 @@
+#include "vertex.h"
+
+#include <QDebug>
+#include <QFloat16>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "qtutils.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define VERTEX_SSE
+#if defined(__F16C__)
+#include <immintrin.h>
+#define VERTEX_F16C
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define VERTEX_NEON
+#endif
+
+#define VERTEX_SIZE 20
+
+namespace vertex
+{
+
+namespace
+{
+
+#if defined(VERTEX_SSE)
+// without F16C the exponent gets rebased with a multiply, which also handles
+// denormals, then inf and nan get their exponent forced back to all ones and nan
+// gets quieted the way vcvtph2ps does it
+__m128 half4(const char *in)
+{
+    const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in));
+#if defined(VERTEX_F16C)
+    return _mm_cvtph_ps(packed);
+#else
+    const __m128i h = _mm_unpacklo_epi16(packed, _mm_setzero_si128());
+    const __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+                                     _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    const __m128i infnan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+    const __m128i nan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7c00));
+    const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expmant), 16);
+    const __m128i forced = _mm_or_si128(_mm_and_si128(infnan, _mm_set1_epi32(255 << 23)),
+                                        _mm_and_si128(nan, _mm_set1_epi32(1 << 22)));
+    return _mm_or_ps(_mm_or_ps(scaled, _mm_castsi128_ps(sign)), _mm_castsi128_ps(forced));
+#endif
+}
+#elif defined(VERTEX_NEON)
+float32x4_t half4(const char *in)
+{
+    return vcvt_f32_f16(vreinterpret_f16_u8(vld1_u8(reinterpret_cast<const uint8_t *>(in))));
+}
+#endif
+
+void normalize(float *v)
+{
+    const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+} // namespace
+
+void halfToFloat(const char *in, float *out, const qsizetype n)
+{
+    qsizetype i = 0;
+#if defined(VERTEX_SSE)
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, half4(in + i * 2));
+    }
+#elif defined(VERTEX_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(out + i, half4(in + i * 2));
+    }
+#endif
+    for (; i < n; ++i) {
+        const quint16 bits = qFromLittleEndian<quint16>(in + i * 2);
+        qfloat16 h;
+        std::memcpy(static_cast<void *>(&h), &bits, sizeof(bits));
+        out[i] = static_cast<float>(h);
+    }
+}
+
+int checkHalves()
+{
+    QList<quint16> halves(65536);
+    std::iota(halves.begin(), halves.end(), 0);
+    QList<float> expected(halves.count());
+    qFloatFromFloat16(expected.data(), reinterpret_cast<const qfloat16 *>(halves.constData()),
+                      halves.count());
+    qToLittleEndian<quint16>(halves.constData(), halves.count(), halves.data());
+    QList<float> floats(halves.count());
+    halfToFloat(reinterpret_cast<const char *>(halves.constData()), floats.data(),
+                halves.count());
+    int mismatched = 0;
+    for (qsizetype i = 0; i < halves.count(); ++i) {
+        if (std::isnan(expected[i]) ? !std::isnan(floats[i])
+                                    : std::memcmp(&expected[i], &floats[i], sizeof(float))) {
+            if (!mismatched++) {
+                qWarning() << "halfToFloat gives" << floats[i] << "for" << Qt::hex << i
+                           << "instead of" << expected[i];
+            }
+        }
+    }
+    return mismatched;
+}
+
+QString decode(const bwm::Level &level, const qsizetype mesh, Stream &out)
+{
+    out = {};
+    if (mesh < 0 || mesh >= level.meshes.count()) {
+        return u"No mesh %1 in this level"_qs.arg(mesh);
+    }
+    const bwm::PODMesh &m = level.meshes[mesh];
+    if (m.vds != VERTEX_SIZE) {
+        return u"Mesh %1 has unknown vertex data stride %2"_qs.arg(mesh).arg(m.vds);
+    }
+    if (m.vdo + qint64(m.vc) * VERTEX_SIZE > level.vertexData.size()) {
+        return u"Mesh %1 runs past the vertex data"_qs.arg(mesh);
+    }
+    const qsizetype n = m.vc;
+    out.count = n;
+    out.uv1.resize(n * 2);
+    out.uv2.resize(n * 2);
+    out.normals.resize(n * 3);
+    out.tangents.resize(n * 4);
+    out.colors.resize(n * 4);
+    float *uv1 = out.uv1.data();
+    float *uv2 = out.uv2.data();
+    float *normals = out.normals.data();
+    float *tangents = out.tangents.data();
+    float *colors = out.colors.data();
+
+    // each vertex is one 4 lane half conversion for both uv pairs, 8 snorm bytes for
+    // normal and tangent and 4 unorm bytes for color
+    const char *src = level.vertexData.data() + m.vdo;
+    for (qsizetype v = 0; v < n; ++v, src += VERTEX_SIZE) {
+#if defined(VERTEX_SSE)
+        const __m128 uv = half4(src);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(uv1 + v * 2), _mm_castps_si128(uv));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(uv2 + v * 2),
+                         _mm_castps_si128(_mm_movehl_ps(uv, uv)));
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 snorm = _mm_set1_ps(1.0f / 127.0f);
+        const __m128 lowest = _mm_set1_ps(-1.0f);
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + 8));
+        // sign extend by putting each byte in the high half and shifting it back down
+        const __m128i words = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+        const __m128 normal = _mm_max_ps(
+            _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16)),
+                       snorm),
+            lowest);
+        const __m128 tangent = _mm_max_ps(
+            _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16)),
+                       snorm),
+            lowest);
+        qint32 rgba;
+        std::memcpy(&rgba, src + 16, sizeof(rgba));
+        const __m128i channels = _mm_unpacklo_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(rgba), zero), zero);
+        float n4[4];
+        _mm_storeu_ps(n4, normal);
+        std::memcpy(normals + v * 3, n4, 3 * sizeof(float));
+        _mm_storeu_ps(tangents + v * 4, tangent);
+        _mm_storeu_ps(colors + v * 4,
+                      _mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_set1_ps(1.0f / 255.0f)));
+#elif defined(VERTEX_NEON)
+        const float32x4_t uv = half4(src);
+        vst1_f32(uv1 + v * 2, vget_low_f32(uv));
+        vst1_f32(uv2 + v * 2, vget_high_f32(uv));
+        const int16x8_t words = vmovl_s8(vld1_s8(reinterpret_cast<const int8_t *>(src + 8)));
+        const float32x4_t lowest = vdupq_n_f32(-1.0f);
+        const float32x4_t normal = vmaxq_f32(
+            vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(words))), 1.0f / 127.0f), lowest);
+        const float32x4_t tangent = vmaxq_f32(
+            vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(words))), 1.0f / 127.0f), lowest);
+        quint32 rgba;
+        std::memcpy(&rgba, src + 16, sizeof(rgba));
+        const uint16x8_t channels = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(rgba)));
+        float n4[4];
+        vst1q_f32(n4, normal);
+        std::memcpy(normals + v * 3, n4, 3 * sizeof(float));
+        vst1q_f32(tangents + v * 4, tangent);
+        vst1q_f32(colors + v * 4,
+                  vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(channels))), 1.0f / 255.0f));
+#else
+        halfToFloat(src, uv1 + v * 2, 2);
+        halfToFloat(src + 4, uv2 + v * 2, 2);
+        for (int k = 0; k < 4; ++k) {
+            if (k < 3) {
+                normals[v * 3 + k] = qMax(qint8(src[8 + k]) / 127.0f, -1.0f);
+            }
+            tangents[v * 4 + k] = qMax(qint8(src[12 + k]) / 127.0f, -1.0f);
+            colors[v * 4 + k] = quint8(src[16 + k]) / 255.0f;
+        }
+#endif
+        // the bytes only get close to unit length, exporters want it exact
+        normalize(normals + v * 3);
+    }
+    return {};
+}
+
+QList<qsizetype> placedMeshes(const bwm::Level &level)
+{
+    QList<qsizetype> placed;
+    QBitArray seen(level.meshes.count());
+    for (const auto &o : level.objects) {
+        if (!o.lod && o.indexStart != o.indexEnd && o.meshIndex < level.meshes.count()
+            && !seen.testBit(o.meshIndex)) {
+            seen.setBit(o.meshIndex);
+            placed.append(o.meshIndex);
+        }
+    }
+    return placed;
+}
+
+QList<Mesh> meshes(const bwm::Level &level, const QList<qsizetype> &indexes)
+{
+    QList<Mesh> sliced(indexes.count());
+    QList<qsizetype> jobs(indexes.count());
+    std::iota(jobs.begin(), jobs.end(), 0);
+    Mesh *out = sliced.data();
+    QtConcurrent::blockingMap(jobs, [&](const qsizetype i) {
+        Mesh &mesh = out[i];
+        mesh.index = indexes[i];
+        if (mesh.index < 0 || mesh.index >= level.meshes.count()) {
+            mesh.error = u"No mesh %1 in this level"_qs.arg(mesh.index);
+            return;
+        }
+        const bwm::PODMesh &m = level.meshes[mesh.index];
+        const qint64 coordsLength = qint64(m.vc) * 12;
+        const qint64 indexesLength = qint64(m.vic) * 2;
+        if (m.vcs != 12 || m.vco + coordsLength > level.vertexCoords.size()
+            || m.vio + indexesLength > level.vertexIndices.size()) {
+            mesh.error = u"Mesh %1 runs past the vertex sections"_qs.arg(mesh.index);
+            return;
+        }
+        mesh.coords = level.vertexCoords.sliced(m.vco, coordsLength);
+        mesh.indexes = level.vertexIndices.sliced(m.vio, indexesLength);
+        for (qint64 v = 0; v < m.vc; ++v) {
+            float p[3];
+            qFromLittleEndian<float>(mesh.coords.data() + v * 12, 3, p);
+            for (int k = 0; k < 3; ++k) {
+                mesh.bounds.min[k] = v ? qMin(mesh.bounds.min[k], p[k]) : p[k];
+                mesh.bounds.max[k] = v ? qMax(mesh.bounds.max[k], p[k]) : p[k];
+            }
+        }
+        const QString error = decode(level, mesh.index, mesh.stream);
+        if (!error.isEmpty()) {
+            qWarning() << error;
+        }
+    });
+    return sliced;
+}
+
+} // namespace vertex
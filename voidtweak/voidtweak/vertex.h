@@ -0,0 +1,52 @@
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+
+#include "bwm.h"
+
+// decoding of the 20 byte per vertex data section of a level: two half float uv
+// pairs, snorm8 normal and tangent, unorm8 color
+namespace vertex
+{
+
+// one mesh's vertex data as floats, each attribute packed on its own
+struct Stream {
+    qsizetype count = 0;
+    QList<float> uv1;      // 2 per vertex
+    QList<float> uv2;      // 2 per vertex
+    QList<float> normals;  // 3 per vertex, normalized
+    QList<float> tangents; // 4 per vertex, w as stored
+    QList<float> colors;   // 4 per vertex, 0-1
+};
+
+// a mesh sliced out of the level's vertex sections with its vertex data decoded,
+// exporters share one between every instance placing the mesh
+struct Mesh {
+    qsizetype index = -1;
+    QByteArrayView coords;  // 3 little-endian floats per vertex
+    QByteArrayView indexes; // 3 little-endian uint16 per triangle
+    bwm::Bounds bounds = {{1, 1, 1}, {0, 0, 0}};
+    Stream stream; // count is 0 when the vertex data couldn't be read
+    QString error; // set when not even coords and indexes could be sliced
+};
+
+// n little-endian half floats
+void halfToFloat(const char *in, float *out, qsizetype n);
+// runs every half through halfToFloat and qfloat16, nan payloads may differ between
+// the two so any two nans count as equal, returns how many halves disagree
+int checkHalves();
+
+QString decode(const bwm::Level &level, qsizetype mesh, Stream &out);
+
+// meshes that non-LOD objects place, in the order they are first used
+QList<qsizetype> placedMeshes(const bwm::Level &level);
+
+// only the requested meshes are sliced and decoded, in parallel
+QList<Mesh> meshes(const bwm::Level &level, const QList<qsizetype> &indexes);
+
+} // namespace vertex
+
+#endif // VERTEX_H
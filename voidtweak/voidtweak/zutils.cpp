@@ -1,6 +1,10 @@
 #include "zutils.h"
 
 #include <QDebug>
+#include <QMutex>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <numeric>
 
 #ifdef Q_OS_WINDOWS
 #include <QtZlib/zlib.h>
@@ -11,10 +15,34 @@
 
 #define ZLIB_INFBUF 0x4000
 #define ZLIB_DEFBUF 0x4000
+// input bytes fit may be deflating at once, each deflate reserves about that much output
+#define ZLIB_FIT_BUDGET (256 * 1024 * 1024)
 
 using namespace zutils;
 
-bool zutils::deflt(QByteArray &input, QByteArray &output)
+QString zutils::describe(const DeflateSettings &settings)
+{
+    QString strategy;
+    switch (settings.strategy) {
+    case Z_FILTERED:
+        strategy = u"filtered"_qs;
+        break;
+    case Z_HUFFMAN_ONLY:
+        strategy = u"huffman"_qs;
+        break;
+    case Z_RLE:
+        strategy = u"rle"_qs;
+        break;
+    default:
+        strategy = u"default"_qs;
+        break;
+    }
+    return u"level %1, memLevel %2, %3 strategy"_qs.arg(settings.level)
+        .arg(settings.memLevel)
+        .arg(strategy);
+}
+
+bool zutils::deflt(QByteArrayView input, QByteArray &output, const DeflateSettings &settings)
 {
     int ret;
     z_Bytef buffer[ZLIB_DEFBUF];
@@ -24,14 +52,16 @@ bool zutils::deflt(QByteArray &input, QByteArray &output)
     stream.zalloc = Z_NULL;
     stream.zfree = Z_NULL;
     stream.opaque = Z_NULL;
-    ret = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 10, 8, Z_DEFAULT_STRATEGY);
+    ret = deflateInit2(&stream, settings.level, Z_DEFLATED, 10, settings.memLevel,
+                       settings.strategy);
     if (ret != Z_OK) {
         qWarning() << "Failed to initialize zlib deflate:" << ret;
         return false;
     }
 
-    stream.next_in = reinterpret_cast<z_Bytef *>(input.data());
+    stream.next_in = reinterpret_cast<z_Bytef *>(const_cast<char *>(input.data()));
     stream.avail_in = input.size();
+    output.reserve(deflateBound(&stream, input.size()));
     do {
         stream.next_out = buffer;
         stream.avail_out = ZLIB_DEFBUF;
@@ -49,7 +79,72 @@ bool zutils::deflt(QByteArray &input, QByteArray &output)
     return ret == Z_STREAM_END;
 }
 
-bool zutils::inflt(QByteArray &input, QByteArray &output)
+bool zutils::fit(QByteArrayView input, qsizetype limit, QByteArray &output,
+                 DeflateSettings *winner)
+{
+    // in order of preference, closest to how the game packed things first. Default
+    // compression is level 6 and rle ignores the level, so those aren't repeated
+    QList<DeflateSettings> candidates = {{Z_DEFAULT_COMPRESSION, 8, Z_DEFAULT_STRATEGY}};
+    for (const int strategy : {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE}) {
+        for (const int memLevel : {9, 8}) {
+            for (int level = Z_BEST_COMPRESSION; level >= 4; --level) {
+                if ((strategy == Z_RLE && level != Z_BEST_COMPRESSION)
+                    || (strategy == Z_DEFAULT_STRATEGY && memLevel == 8 && level == 6)) {
+                    continue;
+                }
+                candidates.append({level, memLevel, strategy});
+            }
+        }
+    }
+
+    // every running deflate holds about a copy of the input, so big assets get fewer
+    // of them at once
+    QThreadPool pool;
+    pool.setMaxThreadCount(static_cast<int>(qBound<qsizetype>(
+        1, ZLIB_FIT_BUDGET / qMax<qsizetype>(input.size(), 1), QThread::idealThreadCount())));
+
+    // only the best result so far is kept: the most preferred one that fits, or the
+    // smallest while nothing fits. Candidates behind a fit don't need to run at all
+    QMutex mutex;
+    qsizetype best = -1;
+    bool bestFits = false;
+    QList<qsizetype> order(candidates.count());
+    std::iota(order.begin(), order.end(), 0);
+    QtConcurrent::blockingMap(&pool, order, [&](const qsizetype i) {
+        {
+            QMutexLocker lock(&mutex);
+            if (bestFits && best < i) {
+                return;
+            }
+        }
+        QByteArray result;
+        if (!deflt(input, result, candidates[i])) {
+            return;
+        }
+        const bool fits = result.size() <= limit;
+        QMutexLocker lock(&mutex);
+        const bool better = fits ? !bestFits || i < best
+                                 : !bestFits && (best < 0 || result.size() < output.size());
+        if (better) {
+            result.squeeze();
+            output = result;
+            best = i;
+            bestFits = fits;
+        }
+    });
+
+    if (best < 0) {
+        output.clear();
+        return false;
+    }
+    if (winner) {
+        *winner = candidates[best];
+    }
+    return bestFits;
+}
+
+bool zutils::inflt(QByteArrayView input, QByteArray &output, qsizetype expected,
+                   qsizetype *consumed)
 {
     int ret;
     z_Bytef buffer[ZLIB_INFBUF];
@@ -65,16 +160,28 @@ bool zutils::inflt(QByteArray &input, QByteArray &output)
         return false;
     }
 
-    stream.next_in = reinterpret_cast<z_Bytef *>(input.data());
+    stream.next_in = reinterpret_cast<z_Bytef *>(const_cast<char *>(input.data()));
     stream.avail_in = input.size();
-    do {
+    if (expected > 0) {
+        output.resize(expected);
+        stream.next_out = reinterpret_cast<z_Bytef *>(output.data());
+        stream.avail_out = expected;
+        ret = inflate(&stream, Z_FINISH);
+        output.resize(expected - stream.avail_out);
+    }
+    // anything the expected size did not cover (or all of it) goes through the buffer,
+    // a Z_BUF_ERROR with room left in the buffer means the input ran out early
+    while (ret == Z_OK || (ret == Z_BUF_ERROR && stream.avail_out == 0)) {
         stream.next_out = buffer;
         stream.avail_out = ZLIB_INFBUF;
         ret = inflate(&stream, Z_FINISH);
         if (stream.avail_out < ZLIB_INFBUF) {
             output.append(reinterpret_cast<char *>(buffer), ZLIB_INFBUF - stream.avail_out);
         }
-    } while (ret == Z_OK || ret == Z_BUF_ERROR);
+    }
+    if (consumed) {
+        *consumed = stream.total_in;
+    }
     inflateEnd(&stream);
 
     if (ret != Z_STREAM_END) {
@@ -2,13 +2,30 @@
 #define ZUTILS_H
 
 #include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
 
 namespace zutils
 {
 
+// mirrors the deflateInit2 arguments, defaults match what the game assets use
+struct DeflateSettings {
+    int level = -1;   // Z_DEFAULT_COMPRESSION
+    int memLevel = 8; // zlib default
+    int strategy = 0; // Z_DEFAULT_STRATEGY
+};
+QString describe(const DeflateSettings &settings);
+
 // odd names to avoid collisions with zlib and qt/zlib globals
-bool deflt(QByteArray &input, QByteArray &output);
-bool inflt(QByteArray &input, QByteArray &output);
+bool deflt(QByteArrayView input, QByteArray &output, const DeflateSettings &settings = {});
+// deflate with many settings in parallel, output is the first in order of preference
+// that fits in limit or the smallest overall if none do, returns whether it fits
+bool fit(QByteArrayView input, qsizetype limit, QByteArray &output,
+         DeflateSettings *winner = nullptr);
+// expected is the inflated size if known (Entry::size), lets us skip the chunked copies
+// consumed is set to the length of the zlib stream, anything after it is slot padding
+bool inflt(QByteArrayView input, QByteArray &output, qsizetype expected = 0,
+           qsizetype *consumed = nullptr);
 
 } // namespace zutils
 